@@ -86,7 +86,7 @@ namespace troll {
     }
 
   private:
-    char buffer[capacity * sizeof(T)];
+    alignas(T) char buffer[capacity * sizeof(T)];
     etl::intrusive_queue<T, Link> queue;
   };
 
@@ -96,9 +96,14 @@ namespace troll {
    * is invalid and free to use.
    * 
    * higher priority => popped early. priority starts from 0 (lowest).
+   *
+   * a bitmap records which priorities have non-empty queues, so the front is
+   * found with one count-leading-zeros instead of scanning every priority.
   */
   template<class T, size_t NPriorities, class Link = forward_link>
   class intrusive_priority_scheduling_queue {
+    static_assert(NPriorities > 0 && NPriorities <= 64, "ready bitmap holds at most 64 priorities");
+
   public:
     using value_type = T;
     using size_type = size_t;
@@ -131,6 +136,37 @@ namespace troll {
         __builtin_unreachable();
       }
       queues[priority].push(value);
+      ready_bitmap |= bitmap_type{1} << priority;
+      ++size_;
+    }
+
+    /**
+     * adds an element with priority, in front of the first element of its queue that
+     * value comes before according to less. a queue only ever filled this way stays
+     * sorted, and elements that are equal keep fifo order. linear in the number of
+     * elements of that priority.
+    */
+    template<class Less>
+    void push_ordered(link_type &value, priority_type priority, Less &&less) {
+      if (priority < 0 || static_cast<size_type>(priority) >= num_priorities) {
+        __builtin_unreachable();
+      }
+      auto &q = queues[priority];
+      bool placed = false;
+      // rotate the whole queue once, dropping value in on the way
+      for (size_type n = q.size(); n; --n) {
+        auto &item = q.front();
+        q.pop();
+        if (!placed && less(static_cast<reference>(value), item)) {
+          q.push(value);
+          placed = true;
+        }
+        q.push(item);
+      }
+      if (!placed) {
+        q.push(value);
+      }
+      ready_bitmap |= bitmap_type{1} << priority;
       ++size_;
     }
 
@@ -142,14 +178,15 @@ namespace troll {
       if (!size_) {
         __builtin_unreachable();
       }
-      for (size_t i = 0; i < num_priorities; ++i) {
-        priority_type p = num_priorities - 1 - i;
-        if (!queues[p].empty()) {
-          reference item = queues[p].front();
-          return {item, p};
-        }
-      }
-      __builtin_unreachable();
+      priority_type p = front_priority();
+      return {queues[p].front(), p};
+    }
+
+    /**
+     * highest priority that has an element. queue must not be empty.
+    */
+    priority_type front_priority() const {
+      return bitmap_bits - 1 - __builtin_clzll(ready_bitmap);
     }
 
     reference front() {
@@ -159,12 +196,50 @@ namespace troll {
     reference pop() {
       auto &&[value, p] = front_tuple();
       queues[p].pop();
+      if (queues[p].empty()) {
+        ready_bitmap &= ~(bitmap_type{1} << p);
+      }
       --size_;
       return value;
     }
 
+    /**
+     * takes value out of the queue of priority, keeping the order of the rest.
+     * linear in the number of elements of that priority. returns whether value
+     * was found.
+    */
+    bool remove(link_type &value, priority_type priority) {
+      if (priority < 0 || static_cast<size_type>(priority) >= num_priorities) {
+        __builtin_unreachable();
+      }
+      auto &q = queues[priority];
+      bool found = false;
+      // rotate the whole queue once, dropping value on the way
+      for (size_type n = q.size(); n; --n) {
+        auto &item = q.front();
+        q.pop();
+        if (static_cast<link_type *>(&item) == &value) {
+          found = true;
+        } else {
+          q.push(item);
+        }
+      }
+      if (found) {
+        if (q.empty()) {
+          ready_bitmap &= ~(bitmap_type{1} << priority);
+        }
+        --size_;
+      }
+      return found;
+    }
+
   private:
+    using bitmap_type = unsigned long long;
+    static constexpr priority_type bitmap_bits = sizeof(bitmap_type) * 8;
+
     etl::intrusive_queue<T, Link> queues[num_priorities];
+    // bit p is set iff queues[p] is not empty
+    bitmap_type ready_bitmap = 0;
     size_type size_ = 0;
   };
 
@@ -207,6 +282,406 @@ namespace troll {
     size_type size_ = 0;
   };
 
+  /**
+   * a fixed size fifo of trivially copyable values. Capacity must be a power of two.
+   * pushing to a full buffer or popping an empty one is not allowed.
+  */
+  template<class T, size_t Capacity>
+  class ring_buffer {
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "capacity must be a power of two");
+
+  public:
+    using value_type = T;
+    using size_type = size_t;
+
+    static constexpr auto capacity = Capacity;
+
+    constexpr ring_buffer() = default;
+    ring_buffer(ring_buffer &) = delete;
+
+    size_type size() const {
+      return tail - head;
+    }
+
+    bool empty() const {
+      return head == tail;
+    }
+
+    bool full() const {
+      return size() == capacity;
+    }
+
+    void push(const value_type &value) {
+      if (full()) {
+        __builtin_unreachable();
+      }
+      buffer[tail++ & (capacity - 1)] = value;
+    }
+
+    /**
+     * the oldest value. it stays in place until it is popped.
+    */
+    value_type &front() {
+      if (empty()) {
+        __builtin_unreachable();
+      }
+      return buffer[head & (capacity - 1)];
+    }
+
+    value_type pop() {
+      if (empty()) {
+        __builtin_unreachable();
+      }
+      return buffer[head++ & (capacity - 1)];
+    }
+
+  private:
+    value_type buffer[capacity];
+    // free running, so head == tail means empty and tail - head == capacity means full
+    size_type head = 0;
+    size_type tail = 0;
+  };
+
+  /**
+   * a fifo of byte strings of any length up to 65535, packed one after another into one
+   * arena of Capacity bytes, so short messages take only their length plus two bytes.
+   * Capacity must be a power of two.
+  */
+  template<size_t Capacity>
+  class message_queue {
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "capacity must be a power of two");
+
+  public:
+    using size_type = size_t;
+    using length_type = uint16_t;
+
+    static constexpr auto capacity = Capacity;
+
+    constexpr message_queue() = default;
+    message_queue(message_queue &) = delete;
+
+    // number of messages
+    size_type size() const {
+      return count;
+    }
+
+    bool empty() const {
+      return count == 0;
+    }
+
+    // bytes taken, length prefixes included
+    size_type used() const {
+      return tail - head;
+    }
+
+    /**
+     * appends a copy of len bytes of data, or returns false if there is no room.
+    */
+    bool push(const void *data, size_type len) {
+      if (len > UINT16_MAX || used() + sizeof(length_type) + len > capacity) {
+        return false;
+      }
+      length_type l = len;
+      copy_in(&l, sizeof l);
+      copy_in(data, len);
+      ++count;
+      return true;
+    }
+
+    /**
+     * length of the oldest message. the queue must not be empty.
+    */
+    size_type front_size() const {
+      if (empty()) {
+        __builtin_unreachable();
+      }
+      length_type l;
+      copy_out(head, &l, sizeof l);
+      return l;
+    }
+
+    /**
+     * moves the oldest message to out, which must hold front_size() bytes, and returns its length.
+    */
+    size_type pop(void *out) {
+      size_type len = front_size();
+      copy_out(head + sizeof(length_type), out, len);
+      head += sizeof(length_type) + len;
+      --count;
+      return len;
+    }
+
+  private:
+    void copy_in(const void *src, size_type len) {
+      size_type at = tail & (capacity - 1);
+      size_type first = len < capacity - at ? len : capacity - at;
+      __builtin_memcpy(arena + at, src, first);
+      __builtin_memcpy(arena, static_cast<const char *>(src) + first, len - first);
+      tail += len;
+    }
+
+    void copy_out(size_type from, void *dst, size_type len) const {
+      size_type at = from & (capacity - 1);
+      size_type first = len < capacity - at ? len : capacity - at;
+      __builtin_memcpy(dst, arena + at, first);
+      __builtin_memcpy(static_cast<char *>(dst) + first, arena, len - first);
+    }
+
+    char arena[capacity];
+    // free running byte offsets, as in ring_buffer
+    size_type head = 0;
+    size_type tail = 0;
+    size_type count = 0;
+  };
+
+  /**
+   * a fifo shared by one producer task and one consumer task without message passing.
+   * Capacity must be a power of two. neither side blocks or makes a syscall in here:
+   * a consumer that found it empty calls prepare_wait() before it sleeps on the
+   * channel event, and the producer signals that event when signal_wanted() says so.
+   *
+   * only plain loads and stores with barriers are used, since exclusive accesses do
+   * not work with the mmu off.
+  */
+  template<class T, size_t Capacity>
+  class spsc_ring {
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "capacity must be a power of two");
+
+  public:
+    using value_type = T;
+    using size_type = size_t;
+
+    static constexpr auto capacity = Capacity;
+
+    constexpr spsc_ring() = default;
+    spsc_ring(spsc_ring &) = delete;
+
+    size_type size() const {
+      return tail - head;
+    }
+
+    bool empty() const {
+      return size() == 0;
+    }
+
+    /**
+     * producer: appends value, or returns false if the ring is full.
+    */
+    bool push(const value_type &value) {
+      size_type t = tail;
+      if (t - head == capacity) {
+        return false;
+      }
+      buffer[t & (capacity - 1)] = value;
+      barrier();
+      tail = t + 1;
+      return true;
+    }
+
+    /**
+     * producer: whether the consumer went to sleep on an empty ring, after a push.
+     * if so, the channel event has to be signalled.
+    */
+    bool signal_wanted() {
+      // the new tail must be visible before waiting is read, and the other way
+      // around in prepare_wait(), or both sides could miss each other
+      barrier();
+      if (!waiting) {
+        return false;
+      }
+      waiting = false;
+      return true;
+    }
+
+    /**
+     * consumer: takes the oldest value into value, or returns false if the ring is empty.
+    */
+    bool pop(value_type &value) {
+      size_type h = head;
+      if (tail == h) {
+        return false;
+      }
+      barrier();
+      value = buffer[h & (capacity - 1)];
+      barrier();
+      head = h + 1;
+      return true;
+    }
+
+    /**
+     * consumer: announces that it is about to wait on the channel event. returns
+     * false if something arrived meanwhile, and it should pop instead of waiting.
+    */
+    bool prepare_wait() {
+      waiting = true;
+      barrier();
+      if (!empty()) {
+        waiting = false;
+        return false;
+      }
+      return true;
+    }
+
+  private:
+    static void barrier() {
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    value_type buffer[capacity];
+    // free running as in ring_buffer. head is written by the consumer only, tail by the producer
+    volatile size_type head = 0;
+    volatile size_type tail = 0;
+    volatile bool waiting = false;
+  };
+
+  /**
+   * a binary min-heap of values keyed on an absolute uint32_t deadline.
+   * deadlines are compared with wraparound, so the ordering stays correct
+   * across counter overflow as long as pending deadlines are less than
+   * 2^31 apart.
+  */
+  template<class V, size_t Capacity>
+  class deadline_queue {
+  public:
+    using value_type = V;
+    using size_type = size_t;
+    using deadline_type = uint32_t;
+
+    struct entry {
+      deadline_type deadline;
+      value_type value;
+    };
+
+    static constexpr auto capacity = Capacity;
+
+    constexpr deadline_queue() = default;
+    deadline_queue(deadline_queue &) = delete;
+
+    size_type size() const {
+      return size_;
+    }
+
+    bool empty() const {
+      return size_ == 0;
+    }
+
+    /**
+     * whether deadline a comes strictly before deadline b.
+    */
+    static bool before(deadline_type a, deadline_type b) {
+      return static_cast<int32_t>(a - b) < 0;
+    }
+
+    void push(deadline_type deadline, const value_type &value) {
+      if (size_ == capacity) {
+        __builtin_unreachable();
+      }
+      size_type i = size_++;
+      while (i > 0) {
+        size_type parent = (i - 1) / 2;
+        if (!before(deadline, heap[parent].deadline)) {
+          break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+      }
+      heap[i] = {deadline, value};
+    }
+
+    /**
+     * the entry with the earliest deadline. queue must not be empty.
+    */
+    const entry &top() const {
+      if (!size_) {
+        __builtin_unreachable();
+      }
+      return heap[0];
+    }
+
+    /**
+     * whether the earliest deadline is at or before now.
+    */
+    bool expired(deadline_type now) const {
+      return size_ && !before(now, heap[0].deadline);
+    }
+
+    void pop() {
+      if (!size_) {
+        __builtin_unreachable();
+      }
+      entry last = heap[--size_];
+      size_type i = 0;
+      while (true) {
+        size_type child = 2 * i + 1;
+        if (child >= size_) {
+          break;
+        }
+        if (child + 1 < size_ && before(heap[child + 1].deadline, heap[child].deadline)) {
+          ++child;
+        }
+        if (!before(heap[child].deadline, last.deadline)) {
+          break;
+        }
+        heap[i] = heap[child];
+        i = child;
+      }
+      heap[i] = last;
+    }
+
+  private:
+    entry heap[capacity];
+    size_type size_ = 0;
+  };
+
+  /**
+   * a histogram of uint32_t samples with power of two buckets. bucket 0 counts
+   * zeros and bucket i counts samples in [2^(i-1), 2^i); the last bucket also
+   * takes everything above. it is an aggregate so it can be copied to user space.
+  */
+  template<size_t NBuckets>
+  struct log2_histogram {
+    static_assert(NBuckets > 1 && NBuckets <= 33);
+
+    static constexpr size_t num_buckets = NBuckets;
+
+    uint32_t count;
+    uint32_t max;
+    uint32_t buckets[num_buckets];
+
+    static size_t bucket_of(uint32_t value) {
+      size_t bucket = value ? 32 - __builtin_clz(value) : 0;
+      return bucket < num_buckets ? bucket : num_buckets - 1;
+    }
+
+    void record(uint32_t value) {
+      ++count;
+      ++buckets[bucket_of(value)];
+      if (value > max) {
+        max = value;
+      }
+    }
+
+    /**
+     * an upper bound of the pct-th percentile sample, never above max.
+    */
+    uint32_t percentile(uint32_t pct) const {
+      if (!count) {
+        return 0;
+      }
+      // rank of the sample, rounded up
+      uint64_t rank = (uint64_t{count} * pct + 99) / 100;
+      uint64_t seen = 0;
+      for (size_t i = 0; i < num_buckets - 1; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+          uint32_t upper = (uint64_t{1} << i) - 1;
+          return upper < max ? upper : max;
+        }
+      }
+      return max;
+    }
+  };
+
   namespace etl {
     // etl::hash<etl::string(|_view|_ext)> is not good here
     // source: https://stackoverflow.com/questions/16075271/hashing-a-string-to-an-integer-in-c
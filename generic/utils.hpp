@@ -1,11 +1,13 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <utility>
 #include <iterator>
 #include <etl/queue.h>
 #include <etl/string.h>
 #include "../kern/user_syscall_typed.hpp"
+#include "containers.hpp"
 
 namespace utils {
 
@@ -75,17 +77,44 @@ namespace utils {
   sd_buffer(etl::string<N>) -> sd_buffer<N>;
 
   /**
-   * a shorthand to create a courier task.
+   * calls f(data, len) for every message of a batch: each message is prefixed with its
+   * uint16_t length, unaligned.
    */
-  template<auto Header, size_t MaxValueSize = 128, size_t MaxQueueSize = 30>
+  template<class F>
+  void for_each_batched(const char *batch, size_t batch_len, F &&f) {
+    size_t i = 0;
+    while (i + sizeof(uint16_t) <= batch_len) {
+      uint16_t len;
+      __builtin_memcpy(&len, batch + i, sizeof len);
+      i += sizeof len;
+      if (i + len > batch_len) {
+        break;
+      }
+      f(batch + i, len);
+      i += len;
+    }
+  }
+
+  /**
+   * a shorthand to create a courier task. queued messages are packed into one arena,
+   * so it holds more of them the shorter they are.
+   *
+   * if BatchHeader is given, the courier takes as many queued messages as fit in
+   * MaxBatchSize bytes in one round trip, and forwards them as one message of
+   * BatchHeader followed by the batch (see for_each_batched()).
+   */
+  template<auto Header, size_t MaxValueSize = 128, size_t MaxQueueSize = 30, auto BatchHeader = nullptr, size_t MaxBatchSize = 128>
   class courier_runner {
   public:
     static constexpr auto header = Header;
     static constexpr auto max_value_size = MaxValueSize;
     static constexpr auto max_queue_size = MaxQueueSize;
+    static constexpr bool batched = !std::is_same_v<decltype(BatchHeader), std::nullptr_t>;
+    static constexpr auto max_batch_size = MaxBatchSize;
+    static_assert(!batched || max_batch_size >= sizeof(uint16_t) + max_value_size, "a batch must hold any message");
 
     courier_runner(priority_t priority, etl::string_view dest) {
-      tid_ = Create(priority, &subtask_run_this_function_);
+      tid_ = Create(priority, &subtask_run_this_function_, STACK_SMALL);
       SendValue(tid_, *dest.data(), dest.size(), null_reply);
     }
 
@@ -93,17 +122,32 @@ namespace utils {
       if (!ready_ || queue_.empty()) {
         return;
       }
-      auto &front = queue_.front();
-      ReplyValue(tid_, front.data, front.len);
-      queue_.pop();
+      if constexpr (batched) {
+        char batch[max_batch_size];
+        size_t len = 0;
+        while (!queue_.empty() && len + sizeof(uint16_t) + queue_.front_size() <= max_batch_size) {
+          uint16_t size = queue_.pop(batch + len + sizeof(uint16_t));
+          __builtin_memcpy(batch + len, &size, sizeof size);
+          len += sizeof size + size;
+        }
+        ReplyValue(tid_, batch, len);
+      } else {
+        char data[max_value_size];
+        auto len = queue_.pop(data);
+        ReplyValue(tid_, data, len);
+      }
       ready_ = false;
     }
 
+    /**
+     * queues data for the destination. returns false if it does not fit anymore.
+     */
     template<class T>
-    void push(const T &data, size_t len = sizeof(T)) {
-      queue_.emplace();
-      queue_.back().len = len;
-      memcpy(queue_.back().data, &data, len);
+    bool push(const T &data, size_t len = sizeof(T)) {
+      if (len > max_value_size) {
+        return false;
+      }
+      return queue_.push(&data, len);
     }
 
     void make_ready() {
@@ -112,28 +156,44 @@ namespace utils {
 
   private:
     static void subtask_run_this_function_() {
-      char buf[max_value_size];
       tid_t parent_tid;
       // receive my destination
-      auto len = ReceiveValue(parent_tid, *buf);
+      char dest[MAX_DEST_NAME_LENGTH + 1];
+      auto len = ReceiveValue(parent_tid, dest, MAX_DEST_NAME_LENGTH);
       ReplyValue(parent_tid, null_reply);
-      buf[len] = '\0';
-      auto dest = etl::string<40>(buf);
-      auto target = TaskFinder(dest.data());
-
-      while (true) {
-        auto len = SendValue(parent_tid, Header, buf);
-        SendValue(target(), buf, len, null_reply);
+      dest[len] = '\0';
+      auto target = TaskFinder(dest);
+
+      if constexpr (batched) {
+        enumed_class<decltype(BatchHeader), char[max_batch_size]> batch;
+        batch.header = BatchHeader;
+        while (true) {
+          auto len = SendValue(parent_tid, Header, batch.data);
+          SendValue(target(), batch, offsetof(decltype(batch), data) + len, null_reply);
+        }
+      } else {
+        char buf[max_value_size];
+        while (true) {
+          auto len = SendValue(parent_tid, Header, buf);
+          SendValue(target(), buf, len, null_reply);
+        }
       }
     }
 
+    static constexpr size_t MAX_DEST_NAME_LENGTH = 40;
+
+    // room for max_queue_size messages of max_value_size bytes, or more shorter ones
+    static constexpr size_t arena_size = [] {
+      size_t size = 1;
+      while (size < max_queue_size * (sizeof(uint16_t) + max_value_size)) {
+        size <<= 1;
+      }
+      return size;
+    }();
+
     tid_t tid_ {};
     bool ready_ {};
-    struct elem_t {
-      char data[max_value_size];
-      size_t len;
-    };
-    etl::queue<elem_t, max_queue_size> queue_;
+    troll::message_queue<arena_size> queue_;
   };
 }
 
@@ -0,0 +1,128 @@
+#include <poll.h>
+#include <stdlib.h>
+#include <time.h>
+#include "host.hpp"
+
+namespace {
+
+bool virtual_clock = false;
+// virtual mode: the cost of one kernel entry and the current time, in nanoseconds
+uint64_t trap_ns = 1000;
+uint64_t virtual_ns = 0;
+// real mode: the monotonic clock at boot
+uint64_t boot_ns = 0;
+
+// the time sync() last brought everything up to
+uint64_t synced_us = 0;
+
+// system timer compare register 1, and its match bit in CS
+uint32_t compare1 = 0;
+bool compare1_matched = false;
+
+uint64_t monotonic_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+}
+
+struct clock_config {
+  clock_config() {
+    auto *mode = getenv("HOST_CLOCK");
+    virtual_clock = mode && mode[0] == 'v';
+    if (auto *ns = getenv("HOST_TRAP_NS")) {
+      trap_ns = strtoull(ns, nullptr, 10);
+    }
+    boot_ns = monotonic_ns();
+  }
+} config;
+
+// the first time after t at which the counter reads the value of C1
+uint64_t next_compare1_match(uint64_t t) {
+  uint32_t delta = compare1 - static_cast<uint32_t>(t);
+  return t + (delta ? delta : 1ull << 32);
+}
+
+uint64_t next_event(uint64_t t) {
+  uint64_t uart_event = host::next_uart_event(t);
+  uint64_t timer_event = next_compare1_match(t);
+  return uart_event < timer_event ? uart_event : timer_event;
+}
+
+bool is_irq_pending() {
+  return host::is_timer_irq_pending() || host::is_uart_irq_pending();
+}
+
+}  // namespace
+
+namespace host {
+
+system_timer_t system_timer;
+
+system_timer_t::clo_t::operator uint32_t() const {
+  return static_cast<uint32_t>(now());
+}
+
+system_timer_t::cs_t &system_timer_t::cs_t::operator=(uint32_t value) {
+  if (value & (1 << 1)) {
+    compare1_matched = false;
+  }
+  return *this;
+}
+
+system_timer_t::c1_t &system_timer_t::c1_t::operator=(uint32_t value) {
+  compare1 = value;
+  return *this;
+}
+
+uint64_t now() {
+  if (virtual_clock) {
+    return virtual_ns / 1000;
+  }
+  return (monotonic_ns() - boot_ns) / 1000;
+}
+
+bool is_virtual_clock() {
+  return virtual_clock;
+}
+
+void charge_trap() {
+  if (virtual_clock) {
+    virtual_ns += trap_ns;
+  }
+}
+
+void sync() {
+  uint64_t t = now();
+  if (t > synced_us && next_compare1_match(synced_us) <= t) {
+    compare1_matched = true;
+  }
+  sync_uarts(t);
+  synced_us = t;
+}
+
+bool is_timer_irq_pending() {
+  return compare1_matched;
+}
+
+void wait_until(bool (*done)()) {
+  for (sync(); !done(); sync()) {
+    // the counter wraps around, so there always is a next compare match
+    uint64_t t = now();
+    uint64_t next = next_event(t);
+    if (virtual_clock) {
+      // nothing happens in between, so skip right to it
+      virtual_ns = next * 1000;
+      continue;
+    }
+    uint64_t wait_us = next - t;
+    timespec timeout = {static_cast<time_t>(wait_us / 1'000'000), static_cast<long>(wait_us % 1'000'000 * 1000)};
+    pollfd input = {uart_poll_fd(), POLLIN, 0};
+    ppoll(&input, input.fd < 0 ? 0 : 1, &timeout, nullptr);
+  }
+}
+
+void wait_for_interrupt() {
+  wait_until(is_irq_pending);
+}
+
+}  // namespace host
@@ -0,0 +1,83 @@
+#include <ucontext.h>
+#include "host.hpp"
+#include "../kern/tasking.hpp"
+#include "../kern/irq.include"
+
+// context switching on top of ucontext. every task runs on its own stack from the
+// task manager, and the ucontext_t of a task is kept at the very top of it.
+//
+// like on the pi, a task whose exception_lr is set starts at exception_lr with x0
+// as its argument. once it runs, exception_lr is cleared and the task is resumed
+// from wherever it last trapped
+
+namespace {
+
+ucontext_t kernel_ucontext;
+volatile kernel::context_t *running = nullptr;
+uint32_t syndrome = 0;
+
+constexpr size_t UCONTEXT_RESERVE = (sizeof(ucontext_t) + SP_ALIGNMENT - 1) & ~(SP_ALIGNMENT - 1);
+
+ucontext_t *task_ucontext(volatile kernel::context_t *context) {
+  return reinterpret_cast<ucontext_t *>(context->stack_pointer - UCONTEXT_RESERVE);
+}
+
+void task_entry() {
+  auto entry = reinterpret_cast<void (*)(int64_t)>(running->exception_lr);
+  int64_t argument = running->registers[0];
+  running->exception_lr = 0;
+  entry(argument);
+  __builtin_unreachable();  // tasks leave through Exit()
+}
+
+void enter_kernel(uint32_t request) {
+  syndrome = request;
+  swapcontext(task_ucontext(running), &kernel_ucontext);
+}
+
+}  // namespace
+
+extern "C" void initialize_kernel() {}
+
+// linux switches the fp/simd registers of every thread itself, so tasks never trap
+extern "C" void save_fp_context(volatile kernel::fp_context_t *) {}
+extern "C" void load_fp_context(volatile kernel::fp_context_t *) {}
+extern "C" void reset_fp_context() {}
+extern "C" void set_fp_trap(bool) {}
+// every switch goes through swapcontext anyway
+extern "C" void set_full_frames(bool) {}
+
+extern "C" int kernel_to_task(volatile kernel::context_t *, volatile kernel::context_t *task_context) {
+  running = task_context;
+  auto *ucontext = task_ucontext(task_context);
+  if (task_context->exception_lr) {
+    getcontext(ucontext);
+    ucontext->uc_stack.ss_sp = reinterpret_cast<char *>(task_context->stack_limit);
+    ucontext->uc_stack.ss_size = task_context->stack_pointer - task_context->stack_limit - UCONTEXT_RESERVE;
+    ucontext->uc_link = nullptr;
+    makecontext(ucontext, task_entry, 0);
+  }
+  swapcontext(&kernel_ucontext, ucontext);
+  running = nullptr;
+  return syndrome;
+}
+
+namespace host {
+
+int64_t svc(uint32_t request, const int64_t *args, size_t num_args) {
+  auto *context = running;
+  charge_trap();
+  sync();
+  // interrupts are only taken at kernel entries, so a task that never makes a
+  // syscall is never preempted
+  while (is_timer_irq_pending() || is_uart_irq_pending()) {
+    enter_kernel(IRQ);
+  }
+  for (size_t i = 0; i < num_args; ++i) {
+    context->registers[i] = args[i];
+  }
+  enter_kernel(request);
+  return context->registers[0];
+}
+
+}  // namespace host
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// user space backend that runs the kernel as a linux process. it stands in for
+// the parts of the pi that kern/ touches directly: context switching
+// (context_switch.S), the syscall stubs (user_syscall.S), the system timer, the
+// gic and the sc16is752 behind spi. see host/README.md
+
+namespace host {
+
+static constexpr uint64_t NO_EVENT = ~uint64_t{0};
+
+/*************** clock ***************/
+
+// microseconds since boot. in virtual mode (HOST_CLOCK=virtual) time only moves
+// by a fixed cost per kernel entry and by skipping ahead to the next event while
+// idling, so runs are repeatable; otherwise it follows the monotonic clock
+uint64_t now();
+bool is_virtual_clock();
+// virtual mode: charge one kernel entry
+void charge_trap();
+
+// brings the timer and the uart emulation up to now()
+void sync();
+// blocks until an interrupt is pending
+void wait_for_interrupt();
+// blocks until done() holds, regardless of which interrupts are enabled
+void wait_until(bool (*done)());
+
+// the system timer registers used by kern/timer.cpp
+struct system_timer_t {
+  struct clo_t {
+    operator uint32_t() const;
+  } CLO;
+  struct cs_t {
+    // writing a 1 clears the match of that compare register
+    cs_t &operator=(uint32_t value);
+  } CS;
+  struct c1_t {
+    c1_t &operator=(uint32_t value);
+  } C1;
+};
+extern system_timer_t system_timer;
+
+bool is_timer_irq_pending();
+
+/*************** uart ***************/
+
+// whatever sits at the other end of a uart channel
+class uart_endpoint {
+public:
+  virtual ~uart_endpoint() = default;
+  // a byte sent by the pi finished transmitting at time t
+  virtual void receive(uint64_t t, char c) = 0;
+  // the next byte for the pi, if one is ready at time t
+  virtual bool transmit(uint64_t t, char &c) = 0;
+  // the cts line at time t
+  virtual bool clear_to_send(uint64_t) { return true; }
+  // the next time the endpoint changes on its own, for the virtual clock
+  virtual uint64_t next_event(uint64_t) { return NO_EVENT; }
+  // a file descriptor to wait on for input that does not follow the clock, or -1
+  virtual int poll_fd() { return -1; }
+};
+
+// channel 0 talks to stdin/stdout
+uart_endpoint &terminal();
+// channel 1 talks to the track
+void set_track_endpoint(uart_endpoint &endpoint);
+// the simulated marklin controller, see merklin_sim.cpp
+uart_endpoint &merklin();
+
+void sync_uarts(uint64_t t);
+uint64_t next_uart_event(uint64_t t);
+bool is_uart_irq_pending();
+int uart_poll_fd();
+
+/*************** tasks ***************/
+
+// svc #request: enters the kernel with request as the exception syndrome.
+// arguments go into x0 and up of the running task, and its x0 comes back as the result
+int64_t svc(uint32_t request, const int64_t *args, size_t num_args);
+
+template<class T>
+inline int64_t to_register(T value) {
+  if constexpr (std::is_pointer_v<T>) {
+    return reinterpret_cast<int64_t>(value);
+  } else {
+    return static_cast<int64_t>(value);
+  }
+}
+
+template<class... Args>
+inline int64_t trap(uint32_t request, Args... args) {
+  int64_t registers[] = {to_register(args)..., 0};
+  return svc(request, registers, sizeof...(Args));
+}
+
+}  // namespace host
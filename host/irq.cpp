@@ -0,0 +1,49 @@
+#include "../kern/irq.hpp"
+#include "host.hpp"
+
+// the host counterpart of kern/irq.cpp. the gic only has to tell which of the
+// two interrupt sources the kernel uses is pending
+
+namespace {
+
+static const uint32_t VIDEO_CORE_BASE = 96;
+static const uint32_t SYSTEM_TIMER_C1 = VIDEO_CORE_BASE + 1;
+static const uint32_t GPIO_IRQ = VIDEO_CORE_BASE + 49;
+static const uint32_t SPURIOUS_IRQ = 1023;
+
+}  // namespace
+
+namespace irq {
+
+void initialize_irq() {}
+
+uint32_t read_interrupt_iar() {
+  host::sync();
+  if (host::is_timer_irq_pending()) {
+    return SYSTEM_TIMER_C1;
+  } else if (host::is_uart_irq_pending()) {
+    return GPIO_IRQ;
+  }
+  return SPURIOUS_IRQ;
+}
+
+uint32_t get_irq_id(uint32_t iar) {
+  return iar;
+}
+
+void end_interrupt(uint32_t) {}
+
+bool is_timer_interrupt(uint32_t irq_id) {
+  return irq_id == SYSTEM_TIMER_C1;
+}
+
+bool is_gpio_interrupt(uint32_t irq_id) {
+  return irq_id == GPIO_IRQ;
+}
+
+// spi transfers finish as soon as they start on the host
+bool is_spi_interrupt(uint32_t) {
+  return false;
+}
+
+}  // namespace irq
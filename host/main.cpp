@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include "host.hpp"
+
+// kmain.cpp is built with main renamed to kernel_main
+int kernel_main();
+
+namespace {
+
+// the task manager keeps every task stack inside itself, and it lives on the
+// kernel stack. that is far more than the default stack of the main thread
+constexpr size_t KERNEL_STACK_SIZE = size_t{1} << 30;
+
+ucontext_t host_context, kernel_context;
+int exit_code = 0;
+
+void run_kernel() {
+  exit_code = kernel_main();
+}
+
+}  // namespace
+
+int main() {
+  void *stack = mmap(nullptr, KERNEL_STACK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (stack == MAP_FAILED) {
+    perror("host: kernel stack");
+    return 1;
+  }
+  host::set_track_endpoint(host::merklin());
+  getcontext(&kernel_context);
+  kernel_context.uc_stack.ss_sp = stack;
+  kernel_context.uc_stack.ss_size = KERNEL_STACK_SIZE;
+  kernel_context.uc_link = &host_context;
+  makecontext(&kernel_context, run_kernel, 0);
+  swapcontext(&host_context, &kernel_context);
+  fflush(stdout);
+  return exit_code;
+}
@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.hpp"
+#include "../track_consts.hpp"
+
+// a marklin controller at the other end of uart channel 1. it understands the
+// bytes tcmd::train_task sends, moves trains over the track graph with the speed
+// and acceleration tables in track_consts.cpp, and reports the sensors they pass.
+//
+// HOST_TRAINS places trains on the track, as a comma separated list of
+// <train>@<node>[+<offset mm>], e.g. "24@A1,58@C13+100". every train faces the
+// direction of the node it is placed on, and starts stopped.
+//
+// two trains whose bodies overlap collide: both stop dead, and the collision is
+// reported on stderr. a summary of what every train did is printed on exit
+
+namespace {
+
+// how long the controller holds cts down after each byte
+constexpr uint64_t CTS_LOW_US = 5000;
+// how long a sensor dump takes to start coming back
+constexpr uint64_t SENSOR_DUMP_LATENCY_US = 2000;
+// trains are moved in steps of at most this much
+constexpr uint64_t MAX_STEP_US = 1000;
+// from the sensor pickup at the front to the end of the train
+constexpr double TRAIN_LENGTH_MM = 200;
+
+constexpr size_t NUM_SENSOR_MODULES = 5;
+constexpr size_t MAX_SIM_TRAINS = tracks::num_trains;
+constexpr size_t MAX_PENDING_BYTES = 2 * NUM_SENSOR_MODULES * 4;
+
+constexpr unsigned char SPEED_REVERSE = 15;
+constexpr unsigned char SPEED_LIGHTS = 16;
+constexpr unsigned char CMD_SOLENOID_OFF = 0x20;
+constexpr unsigned char CMD_SWITCH_STRAIGHT = 0x21;
+constexpr unsigned char CMD_SWITCH_CURVED = 0x22;
+constexpr unsigned char CMD_GO = 0x60;
+constexpr unsigned char CMD_STOP = 0x61;
+constexpr unsigned char CMD_DUMP = 0x80;
+constexpr unsigned char CMD_RESET_MODE = 0xC0;
+
+// a point on the track: offset mm past the source of edge
+struct position_t {
+  const track_edge *edge = nullptr;
+  double offset = 0;
+};
+
+struct sim_train {
+  int num = 0;
+  position_t front;
+  double speed = 0;          // mm/s
+  int level = 0;             // 0 to 14
+  int previous_level = 0;
+  bool stopped_dead = false;  // collided or ran off the track
+
+  // summary
+  double distance = 0;
+  unsigned sensors_hit = 0;
+  unsigned collisions = 0;
+};
+
+class merklin_sim : public host::uart_endpoint {
+public:
+  merklin_sim() {
+#if IS_TRACK_A == 1
+    init_tracka(track);
+#else
+    init_trackb(track);
+#endif
+    if (auto *trains = getenv("HOST_TRAINS")) {
+      place_trains(trains);
+    }
+  }
+
+  ~merklin_sim() {
+    if (!num_trains) {
+      return;
+    }
+    double seconds = last_time / 1e6;
+    fprintf(stderr, "sim: %.1fs simulated, %u collisions\n", seconds, collisions);
+    for (size_t i = 0; i < num_trains; ++i) {
+      auto &train = trains[i];
+      fprintf(stderr, "sim: train %d travelled %.0fmm (%.0fmm/s), hit %u sensors, now at %s+%.0f\n",
+        train.num, train.distance, seconds > 0 ? train.distance / seconds : 0, train.sensors_hit,
+        train.front.edge->src->name, train.front.offset);
+    }
+  }
+
+  void receive(uint64_t t, char c) override {
+    advance(t);
+    cts_low_until = t + CTS_LOW_US;
+    auto byte = static_cast<unsigned char>(c);
+    if (has_first_byte) {
+      has_first_byte = false;
+      command(t, first_byte, byte);
+    } else if (byte < CMD_SOLENOID_OFF || byte == CMD_SWITCH_STRAIGHT || byte == CMD_SWITCH_CURVED) {
+      first_byte = byte;
+      has_first_byte = true;
+    } else {
+      command(t, byte);
+    }
+  }
+
+  bool transmit(uint64_t t, char &c) override {
+    advance(t);
+    if (!num_pending || t < pending_at) {
+      return false;
+    }
+    c = pending[pending_head];
+    pending_head = (pending_head + 1) % MAX_PENDING_BYTES;
+    --num_pending;
+    return true;
+  }
+
+  bool clear_to_send(uint64_t t) override {
+    return t >= cts_low_until;
+  }
+
+  uint64_t next_event(uint64_t t) override {
+    uint64_t next = host::NO_EVENT;
+    if (num_pending && pending_at > t) {
+      next = pending_at;
+    }
+    if (cts_low_until > t && cts_low_until < next) {
+      next = cts_low_until;
+    }
+    return next;
+  }
+
+private:
+  void place_trains(const char *spec) {
+    char buffer[256];
+    strncpy(buffer, spec, sizeof buffer - 1);
+    buffer[sizeof buffer - 1] = '\0';
+    for (char *save, *item = strtok_r(buffer, ",", &save); item; item = strtok_r(nullptr, ",", &save)) {
+      char name[8] = {0};
+      int num = 0, offset = 0;
+      if (sscanf(item, "%d@%7[A-Z0-9]+%d", &num, name, &offset) < 2) {
+        fprintf(stderr, "sim: cannot parse train '%s'\n", item);
+        continue;
+      }
+      const track_node *node = find_node(name);
+      if (!node || !is_valid_train(num) || num_trains == MAX_SIM_TRAINS) {
+        fprintf(stderr, "sim: cannot place train %d at %s\n", num, name);
+        continue;
+      }
+      auto &train = trains[num_trains++];
+      train.num = num;
+      train.front = {&node->edge[DIR_AHEAD], 0};
+      move(train, offset);
+      train.sensors_hit = 0;
+    }
+    // the trains were put there by hand
+    memset(sensors, 0, sizeof sensors);
+  }
+
+  static bool is_valid_train(int num) {
+    for (int valid : tracks::valid_trains()) {
+      if (num == valid) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const track_node *find_node(const char *name) const {
+    for (auto &node : track) {
+      if (node.name && !strcmp(node.name, name)) {
+        return &node;
+      }
+    }
+    return nullptr;
+  }
+
+  sim_train *find_train(int num) {
+    for (size_t i = 0; i < num_trains; ++i) {
+      if (trains[i].num == num) {
+        return &trains[i];
+      }
+    }
+    return nullptr;
+  }
+
+  void command(uint64_t t, unsigned char byte) {
+    if (byte == CMD_GO) {
+      powered = true;
+    } else if (byte == CMD_STOP) {
+      powered = false;
+      for (size_t i = 0; i < num_trains; ++i) {
+        trains[i].speed = 0;
+      }
+    } else if (byte > CMD_DUMP && byte <= CMD_DUMP + NUM_SENSOR_MODULES) {
+      for (size_t module = 0; module < size_t{byte} - CMD_DUMP; ++module) {
+        dump_module(t, module);
+      }
+    } else if (byte > CMD_RESET_MODE && byte <= CMD_RESET_MODE + NUM_SENSOR_MODULES) {
+      dump_module(t, byte - CMD_RESET_MODE - 1);
+    }
+    // solenoid off and reset mode need no action: switches do not burn out here,
+    // and sensors are always reset after being dumped
+  }
+
+  void command(uint64_t, unsigned char first, unsigned char second) {
+    if (first == CMD_SWITCH_STRAIGHT || first == CMD_SWITCH_CURVED) {
+      switches[second] = first == CMD_SWITCH_CURVED ? DIR_CURVED : DIR_STRAIGHT;
+      return;
+    }
+    auto *train = find_train(second);
+    if (!train || !powered) {
+      return;
+    }
+    int speed = first & ~SPEED_LIGHTS;
+    if (speed == SPEED_REVERSE) {
+      reverse(*train);
+    } else {
+      train->previous_level = train->level;
+      train->level = speed;
+    }
+  }
+
+  void dump_module(uint64_t t, size_t module) {
+    if (!num_pending) {
+      pending_at = t + SENSOR_DUMP_LATENCY_US;
+    }
+    // sensor 1 is the highest bit of the first byte, sensor 16 the lowest of the second
+    uint16_t bits = 0;
+    for (size_t i = 0; i < 16; ++i) {
+      if (sensors[module] & (1 << i)) {
+        bits |= 1 << (15 - i);
+      }
+    }
+    sensors[module] = 0;
+    push_pending(bits >> 8);
+    push_pending(bits & 0xff);
+  }
+
+  void push_pending(char c) {
+    if (num_pending < MAX_PENDING_BYTES) {
+      pending[(pending_head + num_pending++) % MAX_PENDING_BYTES] = c;
+    }
+  }
+
+  const track_edge *next_edge(const track_node *node) const {
+    switch (node->type) {
+      case NODE_EXIT: return nullptr;
+      case NODE_BRANCH: return &node->edge[switches[node->num]];
+      default: return &node->edge[DIR_AHEAD];
+    }
+  }
+
+  // moves the front of train forward by distance, tripping sensors on the way.
+  // returns false if the train ran off the end of the track
+  bool move(sim_train &train, double distance) {
+    auto &front = train.front;
+    front.offset += distance;
+    while (front.offset >= front.edge->dist) {
+      const track_node *node = front.edge->dest;
+      if (node->type == NODE_SENSOR) {
+        sensors[node->num / 16] |= 1 << (node->num % 16);
+        ++train.sensors_hit;
+      }
+      auto *edge = next_edge(node);
+      if (!edge) {
+        front.offset = front.edge->dist;
+        return false;
+      }
+      front.offset -= front.edge->dist;
+      front.edge = edge;
+    }
+    return true;
+  }
+
+  // the same spot, facing the other way
+  static position_t flip(position_t pos) {
+    return {pos.edge->reverse, pos.edge->dist - pos.offset};
+  }
+
+  void reverse(sim_train &train) {
+    // the pickup moves to what used to be the back of the train
+    position_t back = flip(train.front);
+    train.front = back;
+    move(train, TRAIN_LENGTH_MM);
+  }
+
+  void advance(uint64_t t) {
+    while (last_time < t) {
+      uint64_t step = t - last_time < MAX_STEP_US ? t - last_time : MAX_STEP_US;
+      last_time += step;
+      if (powered) {
+        step_trains(step / 1e6);
+      }
+    }
+  }
+
+  void step_trains(double dt) {
+    for (size_t i = 0; i < num_trains; ++i) {
+      auto &train = trains[i];
+      if (train.stopped_dead) {
+        continue;
+      }
+      double target = static_cast<double>(tracks::train_speed(train.num, train.level, train.previous_level));
+      double accel = static_cast<double>(tracks::train_acceleration(train.num, train.level, train.previous_level));
+      double speed = train.speed;
+      if (accel <= 0) {
+        speed = target;
+      } else if (speed < target) {
+        speed = speed + accel * dt < target ? speed + accel * dt : target;
+      } else {
+        speed = speed - accel * dt > target ? speed - accel * dt : target;
+      }
+      double distance = (train.speed + speed) / 2 * dt;
+      train.speed = speed;
+      train.distance += distance;
+      if (distance > 0 && !move(train, distance)) {
+        fprintf(stderr, "sim: %.3fs train %d ran off the track at %s\n",
+          last_time / 1e6, train.num, train.front.edge->dest->name);
+        train.speed = 0;
+        train.stopped_dead = true;
+      }
+    }
+    detect_collisions();
+  }
+
+  // whether pos lies on the body of train, which stretches TRAIN_LENGTH_MM behind its front
+  bool occupies(const sim_train &train, position_t pos) const {
+    position_t body = flip(train.front);
+    double remaining = TRAIN_LENGTH_MM;
+    while (remaining > 0) {
+      double end = body.offset + remaining;
+      double edge_end = end < body.edge->dist ? end : body.edge->dist;
+      if (pos.edge == body.edge && body.offset <= pos.offset && pos.offset <= edge_end) {
+        return true;
+      }
+      if (pos.edge == body.edge->reverse) {
+        double flipped = body.edge->dist - pos.offset;
+        if (body.offset <= flipped && flipped <= edge_end) {
+          return true;
+        }
+      }
+      remaining -= edge_end - body.offset;
+      auto *next = next_edge(body.edge->dest);
+      if (!next) {
+        break;
+      }
+      body = {next, 0};
+    }
+    return false;
+  }
+
+  void detect_collisions() {
+    for (size_t i = 0; i < num_trains; ++i) {
+      for (size_t j = 0; j < num_trains; ++j) {
+        auto &a = trains[i], &b = trains[j];
+        if (i == j || a.stopped_dead || !occupies(b, a.front)) {
+          continue;
+        }
+        fprintf(stderr, "sim: %.3fs train %d ran into train %d at %s+%.0f\n",
+          last_time / 1e6, a.num, b.num, a.front.edge->src->name, a.front.offset);
+        ++collisions;
+        for (auto *train : {&a, &b}) {
+          ++train->collisions;
+          train->speed = 0;
+          train->stopped_dead = true;
+        }
+      }
+    }
+  }
+
+  track_node track[TRACK_MAX];
+  unsigned char switches[256] = {0};
+  uint16_t sensors[NUM_SENSOR_MODULES] = {0};
+  sim_train trains[MAX_SIM_TRAINS];
+  size_t num_trains = 0;
+  unsigned collisions = 0;
+  bool powered = false;
+
+  uint64_t last_time = 0;
+  uint64_t cts_low_until = 0;
+  bool has_first_byte = false;
+  unsigned char first_byte = 0;
+
+  char pending[MAX_PENDING_BYTES];
+  size_t pending_head = 0, num_pending = 0;
+  uint64_t pending_at = 0;
+};
+
+}  // namespace
+
+namespace host {
+
+uart_endpoint &merklin() {
+  static merklin_sim sim;
+  return sim;
+}
+
+}  // namespace host
@@ -0,0 +1,385 @@
+#include "../kern/rpi.hpp"
+#include "host.hpp"
+
+// the host counterpart of kern/rpi.cpp. spi is not emulated; instead the
+// functions that would talk to the sc16is752 over spi act on an emulation of its
+// two channels. transmission takes as long as it would at the configured baud
+// rate, and the interrupt output is the "or" of both channels as on the pi
+
+namespace {
+
+using namespace rpi;
+
+static const char UART_LCR_DIV_LATCH_EN  = 0x80;
+static const char UART_FCR_TX_FIFO_RESET = 0x04;
+static const char UART_FCR_RX_FIFO_RESET = 0x02;
+static const char UART_IOControl_RESET   = 0x08;
+
+static const char UART_CHANNEL_SHIFT = 1;
+static const char UART_ADDR_SHIFT    = 3;
+static const char UART_READ_ENABLE   = 0x80;
+
+static const char UART_IER_RHR = 0x01;
+static const char UART_IER_THR = 0x02;
+static const char UART_IER_MSR = 0x08;
+
+static const char UART_IIR_NONE  = 0x01;
+static const char UART_IIR_RHR   = 0x04;
+static const char UART_IIR_THR   = 0x02;
+static const char UART_IIR_MODEM = 0x00;
+
+static const char UART_LSR_DATA_READY = 0x01;
+static const char UART_LSR_THR_EMPTY  = 0x20;
+static const char UART_LSR_TX_EMPTY   = 0x40;
+
+static const char UART_MSR_DELTA_CTS = 0x01;
+static const char UART_MSR_CTS       = 0x10;
+
+constexpr size_t FIFO_SIZE = 64;
+constexpr uint32_t CRYSTAL_FREQ = 14745600;
+
+struct fifo {
+  char data[FIFO_SIZE];
+  size_t head = 0, count = 0;
+
+  bool empty() const { return !count; }
+  bool full() const { return count == FIFO_SIZE; }
+  char front() const { return data[head]; }
+  void push(char c) { data[(head + count++) % FIFO_SIZE] = c; }
+  char pop() {
+    char c = data[head];
+    head = (head + 1) % FIFO_SIZE;
+    --count;
+    return c;
+  }
+  void clear() { count = 0; }
+};
+
+struct sc16is752_channel {
+  host::uart_endpoint *endpoint = nullptr;
+
+  char ier = 0, lcr = 0, mcr = 0, spr = 0, dll = 0, dlh = 0;
+  fifo rx, tx;
+  // when the byte at the front of tx has been shifted out
+  uint64_t tx_done = 0;
+  // the earliest time the next byte can arrive
+  uint64_t rx_free = 0;
+
+  // changes of cts not yet seen through MSR. only the front one is visible, so
+  // a drop and a rise in between two reads of MSR are still two interrupts
+  bool cts_edges[8];
+  size_t num_cts_edges = 0;
+  bool cts_line = true;
+  bool cts_seen = true;
+
+  uint64_t byte_time() const {
+    uint32_t divisor = (static_cast<uint8_t>(dlh) << 8) | static_cast<uint8_t>(dll);
+    uint64_t baud = CRYSTAL_FREQ / (16 * (divisor ? divisor : 1));
+    // start bit, 8 data bits, and one or two stop bits
+    uint64_t bits = (lcr & 0x04) ? 11 : 10;
+    return (bits * 1'000'000 + baud - 1) / baud;
+  }
+
+  void reset() {
+    ier = lcr = mcr = spr = dll = dlh = 0;
+    rx.clear();
+    tx.clear();
+    num_cts_edges = 0;
+  }
+
+  void observe_cts(uint64_t t) {
+    bool cts = endpoint->clear_to_send(t);
+    if (cts != cts_line && num_cts_edges < sizeof cts_edges) {
+      cts_edges[num_cts_edges++] = cts;
+    }
+    cts_line = cts;
+  }
+
+  void advance(uint64_t t) {
+    while (!tx.empty() && tx_done <= t) {
+      endpoint->receive(tx_done, tx.pop());
+      observe_cts(tx_done);
+      if (!tx.empty()) {
+        tx_done += byte_time();
+      }
+    }
+    char c;
+    while (!rx.full() && rx_free <= t && endpoint->transmit(t, c)) {
+      rx.push(c);
+      rx_free = (rx_free > t ? rx_free : t) + byte_time();
+    }
+    observe_cts(t);
+  }
+
+  uint64_t next_event(uint64_t t) const {
+    uint64_t next = endpoint->next_event(t);
+    if (!tx.empty() && tx_done < next) {
+      next = tx_done;
+    }
+    if (rx_free > t && rx_free < next) {
+      next = rx_free;
+    }
+    return next;
+  }
+
+  char iir() const {
+    if ((ier & UART_IER_RHR) && !rx.empty()) {
+      return UART_IIR_RHR;
+    } else if ((ier & UART_IER_THR) && tx.empty()) {
+      return UART_IIR_THR;
+    } else if ((ier & UART_IER_MSR) && num_cts_edges) {
+      return UART_IIR_MODEM;
+    }
+    return UART_IIR_NONE;
+  }
+
+  char msr() {
+    char delta = 0;
+    if (num_cts_edges) {
+      cts_seen = cts_edges[0];
+      for (size_t i = 1; i < num_cts_edges; ++i) {
+        cts_edges[i - 1] = cts_edges[i];
+      }
+      --num_cts_edges;
+      delta = UART_MSR_DELTA_CTS;
+    }
+    return (cts_seen ? UART_MSR_CTS : 0) | delta;
+  }
+
+  void transmit(char c) {
+    if (tx.full()) {
+      return;  // overrun
+    }
+    if (tx.empty()) {
+      uint64_t t = host::now();
+      tx_done = (tx_done > t ? tx_done : t) + byte_time();
+    }
+    tx.push(c);
+  }
+
+  void write(char reg, char data) {
+    if ((lcr & UART_LCR_DIV_LATCH_EN) && (reg == UART_DLL || reg == UART_DLH)) {
+      (reg == UART_DLL ? dll : dlh) = data;
+      return;
+    }
+    if (static_cast<uint8_t>(lcr) == 0xbf && reg == UART_EFR) {
+      return;  // enhanced functions do not change anything here
+    }
+    switch (reg) {
+      case UART_THR: transmit(data); break;
+      case UART_IER: ier = data; break;
+      case UART_FCR: {
+        if (data & UART_FCR_RX_FIFO_RESET) rx.clear();
+        if (data & UART_FCR_TX_FIFO_RESET) tx.clear();
+        break;
+      }
+      case UART_LCR: lcr = data; break;
+      case UART_MCR: mcr = data; break;
+      case UART_SPR: spr = data; break;
+      default: break;
+    }
+  }
+
+  char read(char reg) {
+    switch (reg) {
+      case UART_RHR: return rx.empty() ? 0 : rx.pop();
+      case UART_IER: return ier;
+      case UART_IIR: return iir();
+      case UART_LCR: return lcr;
+      case UART_MCR: return mcr;
+      case UART_LSR: {
+        return (rx.empty() ? 0 : UART_LSR_DATA_READY) | (tx.empty() ? UART_LSR_THR_EMPTY | UART_LSR_TX_EMPTY : 0);
+      }
+      case UART_MSR: return msr();
+      case UART_SPR: return spr;
+      case UART_TXLVL: return FIFO_SIZE - tx.count;
+      case UART_RXLVL: return rx.count;
+      default: return 0;
+    }
+  }
+};
+
+class disconnected_t : public host::uart_endpoint {
+public:
+  void receive(uint64_t, char) override {}
+  bool transmit(uint64_t, char &) override { return false; }
+} disconnected;
+
+sc16is752_channel channels[2];
+
+sc16is752_channel &channel(size_t uart_channel) {
+  if (!channels[0].endpoint) {
+    channels[0].endpoint = &host::terminal();
+  }
+  if (!channels[1].endpoint) {
+    channels[1].endpoint = &disconnected;
+  }
+  return channels[uart_channel & 1];
+}
+
+bool has_rx(size_t uart_channel) {
+  return !channel(uart_channel).rx.empty();
+}
+
+bool has_rx_0() {
+  return has_rx(0);
+}
+
+bool has_rx_1() {
+  return has_rx(1);
+}
+
+}  // namespace
+
+namespace host {
+
+void set_track_endpoint(uart_endpoint &endpoint) {
+  channel(1).endpoint = &endpoint;
+}
+
+void sync_uarts(uint64_t t) {
+  channel(0).advance(t);
+  channel(1).advance(t);
+}
+
+uint64_t next_uart_event(uint64_t t) {
+  uint64_t next0 = channel(0).next_event(t), next1 = channel(1).next_event(t);
+  return next0 < next1 ? next0 : next1;
+}
+
+bool is_uart_irq_pending() {
+  return channel(0).iir() != UART_IIR_NONE || channel(1).iir() != UART_IIR_NONE;
+}
+
+int uart_poll_fd() {
+  int fd = channel(0).endpoint->poll_fd();
+  return fd >= 0 ? fd : channel(1).endpoint->poll_fd();
+}
+
+}  // namespace host
+
+uint32_t read_gpeds() {
+  host::sync();
+  return host::is_uart_irq_pending() ? (1 << 24) : 0;
+}
+
+void set_gpeds(uint32_t) {}
+
+void init_gpio() {}
+
+void init_spi(uint32_t) {}
+
+void init_uart(uint32_t) {
+  channel(0).reset();
+  channel(1).reset();
+  // the same settings as kern/rpi.cpp, minus the spi traffic
+  uart_write_register(0, 0, UART_LCR, UART_LCR_DIV_LATCH_EN);
+  uart_write_register(0, 0, UART_DLL, CRYSTAL_FREQ / (115200 * 16));
+  uart_write_register(0, 0, UART_LCR, 0x3);
+  uart_write_register(0, 1, UART_LCR, UART_LCR_DIV_LATCH_EN);
+  uart_write_register(0, 1, UART_DLL, CRYSTAL_FREQ / (2400 * 16) & 0xff);
+  uart_write_register(0, 1, UART_DLH, CRYSTAL_FREQ / (2400 * 16) >> 8);
+  uart_write_register(0, 1, UART_LCR, 0x7);
+}
+
+void uart_write_register(size_t, size_t uart_channel, char reg, char data) {
+  host::sync();
+  if (reg == UART_IOControl && (data & UART_IOControl_RESET)) {
+    channel(0).reset();
+    channel(1).reset();
+    return;
+  }
+  channel(uart_channel).write(reg, data);
+}
+
+void uart_write_register(size_t, size_t uart_channel, char reg, char *prepare, size_t len) {
+  host::sync();
+  for (size_t i = 1; i <= len; ++i) {
+    channel(uart_channel).write(reg, prepare[i]);
+  }
+}
+
+char uart_read_register(size_t, size_t uart_channel, char reg) {
+  host::sync();
+  return channel(uart_channel).read(reg);
+}
+
+void uart_read_register(size_t, size_t uart_channel, char reg, char *prepare, size_t len) {
+  host::sync();
+  for (size_t i = 1; i <= len; ++i) {
+    prepare[i] = channel(uart_channel).read(reg);
+  }
+}
+
+char uart_register_address(size_t uart_channel, char reg, bool read) {
+  return (uart_channel << UART_CHANNEL_SHIFT) | (reg << UART_ADDR_SHIFT) | (read ? UART_READ_ENABLE : 0);
+}
+
+// there is no spi bus to wait for. the access in buf is decoded and done right away
+bool spi_start_transfer(size_t spi_channel, char *buf, size_t sendlen, size_t recvlen) {
+  size_t uart_channel = (buf[0] >> UART_CHANNEL_SHIFT) & 3;
+  char reg = (buf[0] >> UART_ADDR_SHIFT) & 0xf;
+  if (buf[0] & UART_READ_ENABLE) {
+    uart_read_register(spi_channel, uart_channel, reg, buf, recvlen - 1);
+  } else if (sendlen == 2) {
+    uart_write_register(spi_channel, uart_channel, reg, buf[1]);
+  } else {
+    uart_write_register(spi_channel, uart_channel, reg, buf, sendlen - 1);
+  }
+  return true;
+}
+
+bool spi_continue_transfer() {
+  return false;
+}
+
+bool is_clear_to_send(size_t spi_channel, size_t uart_channel) {
+  return (uart_read_register(spi_channel, uart_channel, UART_MSR) & UART_MSR_CTS) != 0;
+}
+
+bool is_uart_readable(size_t spi_channel, size_t uart_channel) {
+  return uart_read_register(spi_channel, uart_channel, UART_RXLVL) != 0;
+}
+
+bool is_uart_writable(size_t spi_channel, size_t uart_channel) {
+  return uart_read_register(spi_channel, uart_channel, UART_TXLVL) != 0;
+}
+
+void uart_write(size_t spi_channel, size_t uart_channel, char c) {
+  uart_write_register(spi_channel, uart_channel, UART_THR, c);
+}
+
+char uart_read(size_t spi_channel, size_t uart_channel) {
+  return uart_read_register(spi_channel, uart_channel, UART_RHR);
+}
+
+// the polling functions below are for the kernel and early boot. they hand bytes
+// straight to the endpoint instead of waiting for the fifo to drain
+
+char uart_getc(size_t spi_channel, size_t uart_channel) {
+  host::wait_until(uart_channel ? has_rx_1 : has_rx_0);
+  return uart_read_register(spi_channel, uart_channel, UART_RHR);
+}
+
+void uart_putc(size_t, size_t uart_channel, char c) {
+  host::sync();
+  channel(uart_channel).endpoint->receive(host::now(), c);
+}
+
+void uart_puts(size_t spi_channel, size_t uart_channel, const char* buf, size_t blen) {
+  for (size_t i = 0; i < blen; ++i) {
+    uart_putc(spi_channel, uart_channel, buf[i]);
+  }
+}
+
+void uart_putui64(size_t spi_channel, size_t uart_channel, uint64_t n) {
+  char digits[20];
+  int len = 0;
+  do {
+    digits[len++] = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  while (len) {
+    uart_putc(spi_channel, uart_channel, digits[--len]);
+  }
+}
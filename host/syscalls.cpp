@@ -0,0 +1,160 @@
+#include "host.hpp"
+#include "../kern/user_syscall.h"
+
+// the host counterpart of kern/user_syscall.S
+
+using host::trap;
+
+extern "C" int Create(priority_t priority, void (*function)(), stack_class_t stack_class) {
+  return trap(SYSCALLN_CREATE, priority, function, stack_class);
+}
+
+extern "C" int MyTid() {
+  return trap(SYSCALLN_MYTID);
+}
+
+extern "C" int MyParentTid() {
+  return trap(SYSCALLN_MYPARENTTID);
+}
+
+extern "C" void Yield() {
+  trap(SYSCALLN_YIELD);
+}
+
+extern "C" int Send(int tid, const char* msg, int msglen, char* reply, int rplen) {
+  return trap(SYSCALLN_SEND, tid, msg, msglen, reply, rplen);
+}
+
+extern "C" int Receive(int* tid, char* msg, int msglen) {
+  return trap(SYSCALLN_RECEIVE, tid, msg, msglen);
+}
+
+extern "C" int Reply(int tid, const char* reply, int rplen) {
+  return trap(SYSCALLN_REPLY, tid, reply, rplen);
+}
+
+extern "C" int SendShort(int tid, uint64_t w0, uint64_t w1, int msglen, char* reply, int rplen) {
+  return trap(SYSCALLN_SENDSHORT, tid, w0, w1, msglen, reply, rplen);
+}
+
+extern "C" int ReplyShort(int tid, uint64_t w0, uint64_t w1, int rplen) {
+  return trap(SYSCALLN_REPLYSHORT, tid, w0, w1, rplen);
+}
+
+extern "C" int ReplyReceive(int reply_tid, const char* reply, int rplen, int* tid, char* msg, int msglen) {
+  return trap(SYSCALLN_REPLYRECEIVE, reply_tid, reply, rplen, tid, msg, msglen);
+}
+
+extern "C" int SetAlarm(uint32_t target) {
+  return trap(SYSCALLN_SETALARM, target);
+}
+
+extern "C" int AwaitEvent(int eventid) {
+  return trap(SYSCALLN_AWAITEVENT, eventid);
+}
+
+extern "C" int AwaitEventBuffer(int eventid, char* buffer, int buflen) {
+  return trap(SYSCALLN_AWAITEVENTBUFFER, eventid, buffer, buflen);
+}
+
+extern "C" void Exit() {
+  trap(SYSCALLN_EXIT);
+  __builtin_unreachable();
+}
+
+extern "C" int DCache() {
+  return trap(SYSBENCHMARK_DCACHE);
+}
+
+extern "C" int ICache() {
+  return trap(SYSBENCHMARK_ICACHE);
+}
+
+extern "C" int BCache() {
+  return trap(SYSBENCHMARK_BCACHE);
+}
+
+extern "C" int MMUCache() {
+  return trap(SYSBENCHMARK_MMU);
+}
+
+extern "C" void FullFrames(bool full) {
+  trap(SYSBENCHMARK_FRAMES, full);
+}
+
+extern "C" void SaveThePlanet() {
+  trap(SYSCALLN_SAVETHEPLANET);
+}
+
+extern "C" void TimeDistribution(time_distribution_t* time_distribution) {
+  trap(SYSCALLN_TIMEDISTRIBUTION, time_distribution);
+}
+
+extern "C" int TaskProfile(task_profile_t* profiles, size_t max_profiles) {
+  return trap(SYSCALLN_TASKPROFILE, profiles, max_profiles);
+}
+
+extern "C" int SrrHistogram(srr_histogram_t* histograms, size_t max_histograms) {
+  return trap(SYSCALLN_SRRHISTOGRAM, histograms, max_histograms);
+}
+
+extern "C" int StackUsage(int tid, stack_usage_t* usage) {
+  return trap(SYSCALLN_STACKUSAGE, tid, usage);
+}
+
+extern "C" int SetAffinity(int tid, affinity_t cores) {
+  return trap(SYSCALLN_SETAFFINITY, tid, cores);
+}
+
+extern "C" int UartWriteRegister(int channel, char reg, char data) {
+  return trap(SYSCALLN_UARTWRITE, channel, reg, data);
+}
+
+extern "C" int UartWriteRegisterN(int channel, char reg, const char* data, size_t len) {
+  return trap(SYSCALLN_UARTWRITEN, channel, reg, data, len);
+}
+
+extern "C" int UartReadRegister(int channel, char reg) {
+  return trap(SYSCALLN_UARTREAD, channel, reg);
+}
+
+extern "C" int UartReadRegisterN(int channel, char reg, char* data, size_t len) {
+  return trap(SYSCALLN_UARTREADN, channel, reg, data, len);
+}
+
+extern "C" int LookupName(name_key_t key) {
+  return trap(SYSCALLN_LOOKUPNAME, key);
+}
+
+extern "C" int PublishName(name_key_t key, int tid) {
+  return trap(SYSCALLN_PUBLISHNAME, key, tid);
+}
+
+extern "C" int RegisterChannel() {
+  return trap(SYSCALLN_REGISTERCHANNEL);
+}
+
+extern "C" int AwaitChannel(int channel) {
+  return trap(SYSCALLN_AWAITCHANNEL, channel);
+}
+
+extern "C" int SignalChannel(int channel) {
+  return trap(SYSCALLN_SIGNALCHANNEL, channel);
+}
+
+extern "C" int SetPeriodic(uint32_t period, uint32_t deadline) {
+  return trap(SYSCALLN_SETPERIODIC, period, deadline);
+}
+
+extern "C" int WaitNextPeriod() {
+  return trap(SYSCALLN_WAITNEXTPERIOD);
+}
+
+extern "C" int TraceDump(trace_record_t* records, size_t max_records) {
+  return trap(SYSCALLN_TRACEDUMP, records, max_records);
+}
+
+extern "C" void Terminate() {
+  trap(SYSCALLN_TERMINATE);
+  __builtin_unreachable();
+}
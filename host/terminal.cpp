@@ -0,0 +1,86 @@
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include "host.hpp"
+
+// uart channel 0 on stdin and stdout. a terminal is switched to raw mode so that
+// keys arrive one at a time and enter is a '\r', just like through gtkterm.
+// piped input has its newlines turned into '\r' for the same reason
+
+namespace {
+
+termios saved_termios;
+
+void restore_terminal() {
+  tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+}
+
+class terminal_t : public host::uart_endpoint {
+public:
+  terminal_t() {
+    is_tty = isatty(STDIN_FILENO);
+    if (is_tty && !tcgetattr(STDIN_FILENO, &saved_termios)) {
+      termios raw = saved_termios;
+      cfmakeraw(&raw);
+      // keep ctrl-c working
+      raw.c_lflag |= ISIG;
+      tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+      atexit(restore_terminal);
+    }
+  }
+
+  void receive(uint64_t, char c) override {
+    putchar(c);
+    if (c == '\n' || ++unflushed == 64) {
+      flush();
+    }
+  }
+
+  bool transmit(uint64_t, char &c) override {
+    flush();
+    if (closed) {
+      return false;
+    }
+    pollfd input = {STDIN_FILENO, POLLIN, 0};
+    if (poll(&input, 1, 0) <= 0) {
+      return false;
+    }
+    if (read(STDIN_FILENO, &c, 1) != 1) {
+      closed = true;
+      return false;
+    }
+    if (!is_tty && c == '\n') {
+      c = '\r';
+    }
+    return true;
+  }
+
+  int poll_fd() override {
+    return closed ? -1 : STDIN_FILENO;
+  }
+
+private:
+  void flush() {
+    if (unflushed) {
+      fflush(stdout);
+      unflushed = 0;
+    }
+  }
+
+  bool is_tty = false;
+  bool closed = false;
+  size_t unflushed = 0;
+};
+
+}  // namespace
+
+namespace host {
+
+uart_endpoint &terminal() {
+  static terminal_t the_terminal;
+  return the_terminal;
+}
+
+}  // namespace host
@@ -10,9 +10,12 @@ namespace gtkterm {
 
 void gtkterm_rxnotifier() {
   tid_t server = MyParentTid();
+  utils::enumed_class<UART_MESSAGE, uart_rx_batch> message {UART_MESSAGE::RX_NOTIFIER, {}};
   while (1) {
-    SendValue(server, UART_MESSAGE::RX_NOTIFIER, null_reply);
-    AwaitEvent(events_t::UART_R0);
+    int n = AwaitEventBuffer(events_t::UART_R0, message.data.data, sizeof message.data.data);
+    if (n <= 0) continue;
+    message.data.data_size = n;
+    SendValue(server, message, null_reply);
   }
 }
 
@@ -28,23 +31,22 @@ static constexpr size_t MAX_QUEUED_CHARS = 1024*30;
 
 void gtkterm_rxserver() {
   RegisterAs(GTK_RX_SERVER_NAME);
-  tid_t notifier = Create(priority_t::PRIORITY_L1, gtkterm_rxnotifier);
+  tid_t notifier = Create(priority_t::PRIORITY_L1, gtkterm_rxnotifier, STACK_SMALL);
   tid_t request_tid;
-  UART_MESSAGE message;
+  utils::enumed_class<UART_MESSAGE, uart_rx_batch> message;
   etl::queue<tid_t, 50> requester_queue;
   etl::queue<char, MAX_QUEUED_CHARS> char_queue;
+  // while nobody asks for input, the notifier is parked and the kernel holds the bytes
   bool notifier_is_parked = false;
 
   while (1) {
     int request = ReceiveValue(request_tid, message);
     if (request <= 0) continue;
 
-    switch (message) {
+    switch (message.header) {
       case UART_MESSAGE::RX_NOTIFIER: { // notifier
-        int rxlvl = UartReadRegister(0, rpi::UART_RXLVL);
-        while (rxlvl != 0) {
-          char_queue.push(UartReadRegister(0, rpi::UART_RHR));
-          --rxlvl;
+        for (size_t i = 0; i < message.data.data_size; ++i) {
+          char_queue.push(message.data.data[i]);
         }
         while (!requester_queue.empty() && !char_queue.empty()) {
           ReplyValue(requester_queue.front(), char_queue.front());
@@ -77,7 +79,7 @@ void gtkterm_rxserver() {
 
 void gtkterm_txserver() {
   RegisterAs(GTK_TX_SERVER_NAME);
-  tid_t notifier = Create(priority_t::PRIORITY_L1, gtkterm_txnotifier);
+  tid_t notifier = Create(priority_t::PRIORITY_L1, gtkterm_txnotifier, STACK_SMALL);
   tid_t request_tid;
   utils::enumed_class<UART_MESSAGE, char[2048]> message;
   etl::queue<char, MAX_QUEUED_CHARS> char_queue;
@@ -101,8 +103,13 @@ void gtkterm_txserver() {
     }
   };
 
+  // the reply to the current request is sent by the next ReplyReceive
+  tid_t reply_tid = 0;
+  UART_REPLY reply = UART_REPLY::OK;
+
   while (1) {
-    int request = ReceiveValue(request_tid, message);
+    int request = ReplyReceiveValue(reply_tid, reply, sizeof reply, request_tid, message);
+    reply_tid = 0;
     if (request <= 0) continue;
 
     switch (message.header) {
@@ -122,7 +129,7 @@ void gtkterm_txserver() {
       }
       case UART_MESSAGE::PUTC: { // putc
         char_queue.push(message.data_as<char>());
-        ReplyValue(request_tid, UART_REPLY::OK);
+        reply_tid = request_tid;
         try_write();
         if (!char_queue.empty() && notifier_is_parked) {
           notifier_is_parked = false;
@@ -135,7 +142,7 @@ void gtkterm_txserver() {
         for (size_t i = 0; i < dat.data_size; ++i) {
           char_queue.push(dat.data[i]);
         }
-        ReplyValue(request_tid, UART_REPLY::OK);
+        reply_tid = request_tid;
         try_write();
         if (!char_queue.empty() && notifier_is_parked) {
           notifier_is_parked = false;
@@ -149,8 +156,8 @@ void gtkterm_txserver() {
 }
 
 void init_tasks() {
-  Create(priority_t::PRIORITY_L4, gtkterm_txserver);
-  Create(priority_t::PRIORITY_L4, gtkterm_rxserver);
+  Create(priority_t::PRIORITY_L4, gtkterm_txserver, STACK_MEDIUM);
+  Create(priority_t::PRIORITY_L4, gtkterm_rxserver, STACK_MEDIUM);
 }
 
 }
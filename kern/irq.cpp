@@ -11,8 +11,13 @@ static const uint32_t GIC_400_CPU_INTERFACE_BASE = GIC_400_BASE + 0x2000;
 static const uint32_t VIDEO_CORE_BASE = 96;
 static const uint32_t SYSTEM_TIMER_C1 = VIDEO_CORE_BASE + 1;
 static const uint32_t GPIO_IRQ = VIDEO_CORE_BASE + 49;
+static const uint32_t AUX_IRQ = VIDEO_CORE_BASE + 29;  // spi 1 and 2, and the mini uart
 static const uint32_t INTERRUPT_ID_MASK = 0x3FF; // bits[0:9]
 
+void write_register(uint32_t address, uint32_t value) {
+  *reinterpret_cast<volatile uint32_t *>(address) = value;
+}
+
 // ARM GIC spec page 93
 void set_enable_irq_by_id(uint32_t m) {
   uint32_t n = m >> 5; // m DIV 32
@@ -35,11 +40,19 @@ void set_target_irq_by_id(uint32_t m) {
 namespace irq {
 
 void initialize_irq() {
+#if SMP
+  // the firmware of the pi sets up the gic, but qemu does not
+  write_register(GIC_400_DIST_BASE, 1);  // GICD_CTLR: forward interrupts
+  initialize_cpu_interface();
+#endif
   set_enable_irq_by_id(SYSTEM_TIMER_C1);
   set_target_irq_by_id(SYSTEM_TIMER_C1);
 
   set_enable_irq_by_id(GPIO_IRQ);
   set_target_irq_by_id(GPIO_IRQ);
+
+  set_enable_irq_by_id(AUX_IRQ);
+  set_target_irq_by_id(AUX_IRQ);
 }
 
 // ARM GIC spec page 76 and 135
@@ -63,4 +76,22 @@ bool is_gpio_interrupt(uint32_t irq_id) {
   return irq_id == GPIO_IRQ;
 }
 
+bool is_spi_interrupt(uint32_t irq_id) {
+  return irq_id == AUX_IRQ;
+}
+
+#if SMP
+// GICC_PMR and GICC_CTLR in the ARM GIC spec
+void initialize_cpu_interface() {
+  write_register(GIC_400_CPU_INTERFACE_BASE + 0x4, 0xff);  // GICC_PMR: let every priority through
+  write_register(GIC_400_CPU_INTERFACE_BASE, 1);  // GICC_CTLR: signal interrupts to the core
+}
+
+// GICD_SGIR in the ARM GIC spec. sgis cannot be disabled on the gic-400
+void send_sgi(uint32_t core_mask, uint32_t sgi_id) {
+  asm volatile("dsb sy");
+  write_register(GIC_400_DIST_BASE + 0xf00, ((core_mask & 0xff) << 16) | (sgi_id & 0xf));
+}
+#endif
+
 } // namespace irq
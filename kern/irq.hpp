@@ -10,5 +10,12 @@ uint32_t get_irq_id(uint32_t iar);
 void end_interrupt(uint32_t iar);
 bool is_timer_interrupt(uint32_t irq_id);
 bool is_gpio_interrupt(uint32_t irq_id);
+bool is_spi_interrupt(uint32_t irq_id);
+#if SMP
+// each core has its own gic cpu interface to turn on
+void initialize_cpu_interface();
+// raises software generated interrupt sgi_id on the cores in core_mask
+void send_sgi(uint32_t core_mask, uint32_t sgi_id);
+#endif
 
 } // namespace irq
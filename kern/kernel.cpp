@@ -2,6 +2,9 @@
 #include "irq.hpp"
 #include "rpi.hpp"
 #include "gpio.hpp"
+#if HOST_BUILD
+#include "../host/host.hpp"
+#endif
 
 extern "C" void initialize_kernel();
 extern "C" int kernel_to_task(volatile kernel::context_t* kernel_context, volatile kernel::context_t* task_context);
@@ -16,8 +19,30 @@ void initialize() {
   irq::initialize_irq();
 }
 
+#if SMP
+void initialize_secondary_core() {
+  initialize_kernel();
+  irq::initialize_cpu_interface();
+}
+#endif
+
+void arm_next_release(task_manager& the_task_manager, timer& the_timer) {
+#if TICKLESS
+  uint32_t release;
+  if (the_task_manager.next_release(release)) {
+    the_timer.set_alarm(release);
+  }
+#else
+  // releases are checked on every tick
+  (void)the_task_manager;
+  (void)the_timer;
+#endif
+}
+
 void handle_timer_interrupt(task_manager& the_task_manager, timer& the_timer) {
   the_timer.rearm_timer_interrupt();
+  the_task_manager.release_periodic_tasks(the_timer.read_current_tick());
+  arm_next_release(the_task_manager, the_timer);
   the_task_manager.wake_up_tasks_on_event(events_t::TIMER, 1);
 }
 
@@ -32,8 +57,7 @@ void handle_gpio_interrupt(
   switch (interrupt_type) {
   case gpio::GPIO_IRQ_TYPE::RX_TIMEOUT:
   case gpio::GPIO_IRQ_TYPE::RHR: {
-    the_task_manager.wake_up_tasks_on_event(is_channel_0 ? events_t::UART_R0 : events_t::UART_R1, 1);
-    uart_irq_state.disable_rx(uart_channel);
+    the_task_manager.drain_uart_rx(uart_channel, uart_irq_state);
     break;
   }
   case gpio::GPIO_IRQ_TYPE::THR: {
@@ -74,24 +98,108 @@ void handle_gpio_interrupt(task_manager& the_task_manager, gpio::uart_interrupt_
 void handle_interrupt(task_manager& the_task_manager, timer& the_timer, gpio::uart_interrupt_state& uart_irq_state) {
   uint32_t iar = irq::read_interrupt_iar();
   uint32_t irq_id = irq::get_irq_id(iar);
+  the_task_manager.trace(trace_kind_t::INTERRUPT, 0, irq_id);
   if (irq::is_timer_interrupt(irq_id)) {
     handle_timer_interrupt(the_task_manager, the_timer);
   } else if (irq::is_gpio_interrupt(irq_id)) {
     handle_gpio_interrupt(the_task_manager, uart_irq_state);
+  } else if (irq::is_spi_interrupt(irq_id)) {
+    the_task_manager.continue_spi();
   }
   irq::end_interrupt(iar);
 }
 
+// the host has its own caches, so these do nothing there
+
+#if !HOST_BUILD
+namespace {
+
+// SCTLR_EL1 bits
+constexpr uint64_t SCTLR_M = 1 << 0;
+constexpr uint64_t SCTLR_C = 1 << 2;
+constexpr uint64_t SCTLR_I = 1 << 12;
+
+// writes back and drops every line of the data and unified caches of this core, by set and way
+void clean_invalidate_dcache() {
+  uint64_t clidr;
+  asm volatile("mrs %x0, CLIDR_EL1" : "=r"(clidr));
+  uint64_t levels = (clidr >> 24) & 7;  // level of coherence
+  for (uint64_t level = 0; level < levels; ++level) {
+    if (((clidr >> (level * 3)) & 7) < 2) {
+      continue;  // no data cache at this level
+    }
+    uint64_t ccsidr;
+    asm volatile("msr CSSELR_EL1, %x1\n\tisb\n\tmrs %x0, CCSIDR_EL1" : "=r"(ccsidr) : "r"(level << 1));
+    uint32_t line_shift = (ccsidr & 7) + 4;
+    uint32_t ways = ((ccsidr >> 3) & 0x3ff) + 1;
+    uint32_t sets = ((ccsidr >> 13) & 0x7fff) + 1;
+    uint32_t way_shift = ways > 1 ? __builtin_clz(ways - 1) : 0;
+    for (uint64_t way = 0; way < ways; ++way) {
+      for (uint64_t set = 0; set < sets; ++set) {
+        uint64_t operand = (way << way_shift) | (set << line_shift) | (level << 1);
+        asm volatile("dc cisw, %x0" :: "r"(operand) : "memory");
+      }
+    }
+  }
+  asm volatile("dsb sy\n\tisb" ::: "memory");
+}
+
+// sets the bits of mask in SCTLR_EL1 to those of bits
+void update_sctlr(uint64_t bits, uint64_t mask) {
+  uint64_t sctlr;
+  asm volatile("mrs %x0, SCTLR_EL1" : "=r"(sctlr));
+  uint64_t next = (sctlr & ~mask) | bits;
+  // ram is only cached with both the mmu and the data cache on. once accesses bypass the
+  // cache, dirty lines have to be in ram, and lines left behind would go stale
+  auto cached = [](uint64_t v) { return (v & SCTLR_M) && (v & SCTLR_C); };
+  bool flush = cached(sctlr) && !cached(next);
+  if (flush) {
+    clean_invalidate_dcache();
+  }
+  asm volatile("dsb sy\n\tmsr SCTLR_EL1, %x0\n\tisb" :: "r"(next) : "memory");
+  if (flush) {
+    // whatever was written back in between
+    clean_invalidate_dcache();
+  }
+  asm volatile("ic iallu\n\tdsb sy\n\tisb" ::: "memory");
+}
+
+}  // namespace
+#endif
+
+// these turn the mmu off, so that each cache is measured on its own
+
 void enable_dcache() {
-  asm volatile("msr SCTLR_EL1, %x0\n\t" :: "r"(1 << 2));
-  asm volatile("IC IALLUIS");
+#if !HOST_BUILD
+  update_sctlr(SCTLR_C, SCTLR_M | SCTLR_C | SCTLR_I);
+#endif
 }
 
 void enable_bcache() {
-  asm volatile("msr SCTLR_EL1, %x0\n\t" :: "r"((1 << 2) | (1 << 12)));
+#if !HOST_BUILD
+  update_sctlr(SCTLR_C | SCTLR_I, SCTLR_M | SCTLR_C | SCTLR_I);
+#endif
 }
 
 void enable_icache() {
-  asm volatile("msr SCTLR_EL1, %x0\n\t" :: "r"(1 << 12));
+#if !HOST_BUILD
+  update_sctlr(SCTLR_I, SCTLR_M | SCTLR_C | SCTLR_I);
+#endif
+}
+
+void enable_mmu() {
+#if !HOST_BUILD
+  // boot.S set up the translation tables of every core, even if it left the mmu off
+  update_sctlr(SCTLR_M | SCTLR_C | SCTLR_I, SCTLR_M | SCTLR_C | SCTLR_I);
+#endif
+}
+
+void wait_for_interrupt() {
+#if HOST_BUILD
+  host::wait_for_interrupt();
+#else
+  asm volatile("dsb ish");
+  asm volatile("wfi");
+#endif
 }
 }  // namespace kernel
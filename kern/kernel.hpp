@@ -7,8 +7,18 @@
 namespace kernel {
 int activate_task(volatile context_t* kernel_context, task_descriptor* current_task);
 void initialize();
+#if SMP
+// what initialize does for the core, on the other cores
+void initialize_secondary_core();
+#endif
+// tickless mode: has the timer interrupt at the earliest release of a periodic task.
+// the periodic timer sees every release on its own
+void arm_next_release(task_manager& the_task_manager, timer& the_timer);
 void handle_interrupt(task_manager& the_task_manager, timer& the_timer, gpio::uart_interrupt_state& uart_irq_state);
 void enable_dcache();
 void enable_bcache();
 void enable_icache();
+void enable_mmu();
+// sleep until an interrupt is pending. the interrupt is not taken
+void wait_for_interrupt();
 }  // namespace kernel
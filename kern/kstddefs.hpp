@@ -30,19 +30,81 @@ struct time_distribution_t {
 
 static constexpr size_t NUM_PRIORITIES = priority_t::PRIORITY_UNDEFINED;
 
-static constexpr size_t TASK_STACK_SIZE/*_BYTES*/ = 1024 * 1024 * 4;
-static constexpr size_t MAX_NUM_TASKS = 50;
+static constexpr size_t MAX_NUM_TASKS = 512;
+
+// a task gets its stack from the pool of the class passed to Create()
+enum stack_class_t {
+  STACK_SMALL = 0,  // notifiers, couriers
+  STACK_MEDIUM,     // servers
+  STACK_LARGE,      // the default
+  NUM_STACK_CLASSES,
+};
+
+static constexpr size_t STACK_CLASS_SIZES/*_BYTES*/[NUM_STACK_CLASSES] = {64 * 1024, 512 * 1024, 4 * 1024 * 1024};
+// number of stacks in each pool
+static constexpr size_t STACK_CLASS_COUNTS[NUM_STACK_CLASSES] = {384, 64, 24};
+
+// see StackUsage()
+struct stack_usage_t {
+  stack_class_t stack_class;
+  uint32_t size;        // bytes
+  uint32_t high_water;  // the most bytes the task has used so far
+};
 
 static constexpr size_t SP_ALIGNMENT = 16;
 
+// messages up to this size can travel in two registers (SendShort/ReplyShort)
+static constexpr size_t MAX_SHORT_MESSAGE_SIZE = 16;
+
 static constexpr tid_t KERNEL_TID = 1;
 static constexpr tid_t STARTING_TASK_TID = 2;
-static constexpr tid_t ENDING_TASK_TID = STARTING_TASK_TID + MAX_NUM_TASKS;
 
-static_assert(!(TASK_STACK_SIZE % SP_ALIGNMENT));
+// the low TID_INDEX_BITS of a tid are the index of its task descriptor plus STARTING_TASK_TID,
+// and the bits above up to bit 30 are the generation of the descriptor, i.e. how many tasks
+// had it before. a stale tid thus never equals the tid of the task that reuses its
+// descriptor, at least until the generation wraps around
+static constexpr unsigned TID_INDEX_BITS = 10;
+static constexpr unsigned TID_GENERATION_BITS = 31 - TID_INDEX_BITS;
+static_assert(STARTING_TASK_TID + MAX_NUM_TASKS <= (1u << TID_INDEX_BITS));
+
+constexpr tid_t make_tid(size_t index, uint32_t generation) {
+  return ((generation & ((1u << TID_GENERATION_BITS) - 1)) << TID_INDEX_BITS) | (index + STARTING_TASK_TID);
+}
+
+// index of the task descriptor of tid. not below MAX_NUM_TASKS if tid cannot be a task
+constexpr size_t tid_index(tid_t tid) {
+  return static_cast<size_t>(tid & ((1u << TID_INDEX_BITS) - 1)) - STARTING_TASK_TID;
+}
+
+static_assert(!(STACK_CLASS_SIZES[STACK_SMALL] % SP_ALIGNMENT));
+static_assert(!(STACK_CLASS_SIZES[STACK_MEDIUM] % SP_ALIGNMENT));
+static_assert(!(STACK_CLASS_SIZES[STACK_LARGE] % SP_ALIGNMENT));
 
 #define EXITED_PARENT_MASK (1 << 31)
 
+// whether tid can be the tid of a task. the task might have exited
+constexpr bool is_task_tid(tid_t tid) {
+  return !(tid & EXITED_PARENT_MASK) && tid_index(tid) < MAX_NUM_TASKS;
+}
+
+using name_key_t = uint32_t;
+
+// 32 bit fnv-1a of a task name. tasks are looked up by this key instead of the
+// string, and a literal name is hashed at compile time. 0 is never a key
+constexpr name_key_t name_key(const char *name) {
+  name_key_t hash = 2166136261u;
+  while (*name) {
+    hash = (hash ^ static_cast<unsigned char>(*name++)) * 16777619u;
+  }
+  return hash ? hash : 1;
+}
+
+// slots of the name cache of the kernel, a power of two
+static constexpr size_t NAME_CACHE_SIZE = 128;
+
+// shared memory channels the kernel can signal
+static constexpr size_t MAX_NUM_CHANNELS = 8;
+
 enum events_t {
   TIMER = 0,
   // for gtkterm
@@ -57,13 +119,120 @@ enum events_t {
 
 static constexpr size_t MAX_NUM_EVENTS = events_t::EVENT_UNDEFINED;
 
+// bytes the kernel keeps for each uart channel that were received but not awaited yet
+static constexpr size_t UART_RX_BUFFER_SIZE = 1024;
+// depth of the rx fifo of a channel of the sc16is752
+static constexpr size_t UART_FIFO_SIZE = 64;
+
 #include "user_syscall.include"
 
+namespace kernel {
+  enum class task_state_t : int {
+    Free,    // in free list
+    Active,  // currently running
+    Ready,   // can be run
+    Blocked, // waiting on something
+    SendWait,    // sender waiting on receiver
+    ReceiveWait, // receiver waiting on sender
+    ReplyWait,   // sender waiting on reply
+    EventWait,   // waiting on some event
+  };
+}  // namespace kernel
+
+static constexpr size_t NUM_TASK_STATES = static_cast<size_t>(kernel::task_state_t::EventWait) + 1;
+
+// per task counters, filled in by TaskProfile(). ticks are system timer ticks
+struct task_profile_t {
+  tid_t tid;
+  priority_t priority;
+  uint64_t run_ticks;   // time spent running in user mode
+  uint64_t dispatches;  // times the task was activated
+  uint64_t interrupts;  // times the task was preempted by an irq
+  uint64_t state_ticks[NUM_TASK_STATES];  // time spent in each task_state_t
+  uint32_t syscalls[SYSCALLN_INVALID];    // syscalls made, by syscall number
+  uint32_t deadline_misses;   // periodic tasks: releases finished after their deadline
+  uint32_t skipped_releases;  // periodic tasks: releases that passed while still running
+};
+
+// the kernel runs as a linux process on top of host/ instead of on the pi
+#ifndef HOST_BUILD
+#define HOST_BUILD 0
+#endif
+
+// smp mode runs the kernel on all four cores, each with its own ready queues
+#ifndef SMP
+#define SMP 0
+#endif
+#if SMP && HOST_BUILD
+#error "the host build runs on one core"
+#endif
+
+static constexpr size_t NUM_CORES = SMP ? 4 : 1;
+// device interrupts are only routed to this core
+static constexpr size_t IRQ_CORE = 0;
+
+// bit n set: the task may run on core n
+using affinity_t = uint32_t;
+static constexpr affinity_t ALL_CORES = (1u << NUM_CORES) - 1;
+static constexpr affinity_t NON_IRQ_CORES = ALL_CORES & ~(1u << IRQ_CORE);
+
 // hardware
+#if HOST_BUILD
+namespace host {
+uint64_t now();
+}
+#define GET_TIMER_COUNT() (static_cast<unsigned>(host::now()))
+#define GET_TIMER_COUNT_HI() (static_cast<unsigned>(host::now() >> 32))
+#else
 #define GET_TIMER_COUNT() (*reinterpret_cast<volatile unsigned *>(0xfe003000 + 0x04))
+#define GET_TIMER_COUNT_HI() (*reinterpret_cast<volatile unsigned *>(0xfe003000 + 0x08))
+#endif
 
 static constexpr unsigned TIMER_FREQ = 1'000'000;  // 1mhz
 static constexpr unsigned NUM_TICKS_IN_1US = 1'000'000 / TIMER_FREQ; // microseconds
 static constexpr unsigned NUM_TICKS_IN_1MS = NUM_TICKS_IN_1US * 1000; // milliseconds
 // DEBUG: change this
 static constexpr unsigned TIMER_INTERRUPT_INTERVAL = 10 * NUM_TICKS_IN_1MS; // 10ms
+
+// in tickless mode the timer only interrupts at the earliest deadline the clock
+// server asked for, instead of every TIMER_INTERRUPT_INTERVAL
+#ifndef TICKLESS
+#define TICKLESS 0
+#endif
+
+// boot.S turns on the mmu, so that ram is cached. the tables are set up even without it
+#ifndef MMU
+#define MMU 1
+#endif
+
+// with priority inheritance a task runs at least at the priority of every task
+// blocked sending to it, whether still in its mailbox or waiting for the reply
+#ifndef PRIORITY_INHERITANCE
+#define PRIORITY_INHERITANCE 0
+#endif
+
+// the kernel records every dispatch, syscall, interrupt and wakeup in a ring of the
+// last TRACE_BUFFER_SIZE records, which TraceDump() reads out
+#ifndef TRACING
+#define TRACING 0
+#endif
+static constexpr size_t TRACE_BUFFER_SIZE = 4096;
+
+enum class trace_kind_t : uint8_t {
+  DISPATCH,   // the task starts running
+  SYSCALL,    // the task entered the kernel with request arg (IRQ and FP_TRAP too)
+  INTERRUPT,  // the kernel took irq arg. tid is 0
+  WAKEUP,     // event arg woke the task
+  RELEASE,    // the kernel released the periodic task
+  SIGNAL,     // channel arg woke the task
+};
+
+// one record of the kernel trace. this is also the wire format of tools/trace2chrome.py
+struct trace_record_t {
+  uint32_t time;  // system timer ticks
+  tid_t tid;
+  trace_kind_t kind;
+  uint8_t core;
+  uint16_t arg;
+};
+static_assert(sizeof(trace_record_t) == 12);
@@ -10,9 +10,12 @@ namespace merklin {
 
 void merklin_rxnotifer() {
   tid_t server = MyParentTid();
+  utils::enumed_class<UART_MESSAGE, uart_rx_batch> message {UART_MESSAGE::RX_NOTIFIER, {}};
   while (1) {
-    AwaitEvent(events_t::UART_R1);
-    SendValue(server, UART_MESSAGE::RX_NOTIFIER, null_reply);
+    int n = AwaitEventBuffer(events_t::UART_R1, message.data.data, sizeof message.data.data);
+    if (n <= 0) continue;
+    message.data.data_size = n;
+    SendValue(server, message, null_reply);
   }
 }
 
@@ -49,33 +52,44 @@ void merklin_txnotifier() {
 
 void merklin_rxserver() {
   RegisterAs(MERK_RX_SERVER_NAME);
-  tid_t notifier = Create(priority_t::PRIORITY_L1, merklin_rxnotifer);
+  tid_t notifier = Create(priority_t::PRIORITY_L1, merklin_rxnotifer, STACK_SMALL);
   tid_t request_tid;
-  UART_MESSAGE message;
-  etl::queue<char, 10> char_queue;
+  utils::enumed_class<UART_MESSAGE, uart_rx_batch> message;
+  etl::queue<char, 2 * MAX_UART_RX_BATCH> char_queue;
   etl::queue<tid_t, 10> requester_queue;
-  // bool is_first_notifier_msg = true;
+  // the notifier is parked while another batch might not fit. the kernel holds the bytes meanwhile
+  bool notifier_is_parked = false;
+
+  auto serve = [&] {
+    while (!requester_queue.empty() && !char_queue.empty()) {
+      ReplyValue(requester_queue.front(), char_queue.front());
+      requester_queue.pop();
+      char_queue.pop();
+    }
+  };
 
   while (1) {
     int request = ReceiveValue(request_tid, message);
     if (request <= 0) continue;
-    switch (message) {
+    switch (message.header) {
       case UART_MESSAGE::RX_NOTIFIER: { // notifier
-        char_queue.push(UartReadRegister(1, rpi::UART_RHR));
-        ReplyValue(notifier, UART_REPLY::OK);
-        if (!requester_queue.empty()) {
-          ReplyValue(requester_queue.front(), char_queue.front());
-          requester_queue.pop();
-          char_queue.pop();
+        for (size_t i = 0; i < message.data.data_size; ++i) {
+          char_queue.push(message.data.data[i]);
+        }
+        serve();
+        if (char_queue.available() >= MAX_UART_RX_BATCH) {
+          ReplyValue(notifier, UART_REPLY::OK);
+        } else {
+          notifier_is_parked = true;
         }
         break;
       }
       case UART_MESSAGE::GETC: { // getc
         requester_queue.push(request_tid);
-        if (!char_queue.empty()) {
-          ReplyValue(requester_queue.front(), char_queue.front());
-          requester_queue.pop();
-          char_queue.pop();
+        serve();
+        if (notifier_is_parked && char_queue.available() >= MAX_UART_RX_BATCH) {
+          notifier_is_parked = false;
+          ReplyValue(notifier, UART_REPLY::OK);
         }
         break;
       }
@@ -86,13 +100,13 @@ void merklin_rxserver() {
 
 void merklin_txserver() {
   RegisterAs(MERK_TX_SERVER_NAME);
-  tid_t tx_notifier = Create(priority_t::PRIORITY_L1, merklin_txnotifier);
+  tid_t tx_notifier = Create(priority_t::PRIORITY_L1, merklin_txnotifier, STACK_SMALL);
 
 #if NO_CTS
-  tid_t d_notifier = Create(priority_t::PRIORITY_L2, delay_notifier);
+  tid_t d_notifier = Create(priority_t::PRIORITY_L2, delay_notifier, STACK_SMALL);
   bool can_send = false;
 #else
-  tid_t cts_notifier = Create(priority_t::PRIORITY_L1, merklin_ctsnotifier);
+  tid_t cts_notifier = Create(priority_t::PRIORITY_L1, merklin_ctsnotifier, STACK_SMALL);
   bool cts_gone_back_up = true;
   bool cts = true;
 #endif
@@ -159,8 +173,8 @@ void merklin_txserver() {
 }
 
 void init_tasks() {
-  Create(priority_t::PRIORITY_L1, merklin_txserver);
-  Create(priority_t::PRIORITY_L1, merklin_rxserver);
+  Create(priority_t::PRIORITY_L1, merklin_txserver, STACK_MEDIUM);
+  Create(priority_t::PRIORITY_L1, merklin_rxserver, STACK_MEDIUM);
 }
 
 }
@@ -27,16 +27,23 @@ int WhoIs(const char* name) {
   if (!name) {
     return -2;
   }
+  return WhoIsKey(name_key(name));
+}
 
-  char request_buffer[33];
-  request_buffer[0] = 'w';
-  size_t request_length = 1;
-  while (*name) {
-    request_buffer[request_length++] = *(name++);
+int WhoIsKey(name_key_t key) {
+  if (int tid = LookupName(key); tid > 0) {
+    return tid;
   }
-  request_buffer[request_length++] = '\0';
+
+  // not cached: the nameserver has every name, and caches it again
+  char request_buffer[5];
+  request_buffer[0] = 'k';
+  request_buffer[1] = key;
+  request_buffer[2] = key >> 8;
+  request_buffer[3] = key >> 16;
+  request_buffer[4] = key >> 24;
   char reply_buffer[4];
-  int reply_len = SendValue(3, request_buffer, request_length, reply_buffer);
+  int reply_len = SendValue(3, request_buffer, sizeof(request_buffer), reply_buffer);
   if (reply_len < 0) {
     return -1;
   }
@@ -44,7 +51,9 @@ int WhoIs(const char* name) {
     return 0; // no task with this name
   }
   if (reply_len == 4) {
-    tid_t the_tid = reply_buffer[0] + (reply_buffer[1] << 8) + (reply_buffer[2] << 16) + (reply_buffer[3] << 24);
+    // the upper bytes hold the generation, so they must not be sign extended
+    auto *bytes = reinterpret_cast<unsigned char*>(reply_buffer);
+    tid_t the_tid = bytes[0] + (bytes[1] << 8) + (bytes[2] << 16) + (bytes[3] << 24);
     return the_tid;
   }
   return -2; // failed for some reason
@@ -6,7 +6,7 @@
 void clocknotifier() {
   tid_t clock_server_tid = WhoIs("clock_server");
 
-  if (!(STARTING_TASK_TID <= clock_server_tid && clock_server_tid <= ENDING_TASK_TID)) {
+  if (!is_task_tid(clock_server_tid)) {
     DEBUG_LITERAL("Error querying the clock server tid from notifier...\r\n");
     return;
   }
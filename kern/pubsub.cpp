@@ -0,0 +1,200 @@
+#include "pubsub.hpp"
+#include "servers.hpp"
+#include <etl/queue.h>
+
+namespace pubsub {
+
+namespace {
+
+// what a courier is handed: the subscriber, and the message for it
+struct delivery_t {
+  tid_t to;
+  uint64_t header;
+  char data[MAX_EVENT_SIZE];
+};
+
+void pubsub_courier() {
+  tid_t server = MyParentTid();
+  const auto ready = pubsub_msg_header::COURIER_READY;
+  delivery_t delivery;
+  while (1) {
+    int len = SendValue(server, ready, delivery);
+    if (len < static_cast<int>(offsetof(delivery_t, data))) {
+      continue;
+    }
+    // the subscriber sees its own header followed by the event
+    SendValue(delivery.to, delivery.header, len - offsetof(delivery_t, header), null_reply);
+  }
+}
+
+struct subscriber_t {
+  tid_t tid;
+  tid_t courier;
+  // the courier waits for the next event
+  bool courier_ready;
+  etl::queue<size_t, MAX_PENDING_EVENTS> events;  // indices into the event pool
+  size_t dropped;
+};
+
+struct subscription_t {
+  size_t subscriber;
+  uint64_t header;
+};
+
+struct event_t {
+  topic_t topic;
+  size_t len;
+  char data[MAX_EVENT_SIZE];
+  // subscribers that still have it queued
+  size_t refs;
+};
+
+}  // namespace
+
+void pubsub_server() {
+  RegisterAs(PUBSUB_SERVER_NAME);
+
+  subscriber_t subscribers[MAX_SUBSCRIBERS] {};
+  size_t num_subscribers = 0;
+  subscription_t subscriptions[NUM_TOPICS][MAX_SUBSCRIBERS];
+  size_t num_subscriptions[NUM_TOPICS] {};
+
+  // an event is stored once however many subscribers it goes to
+  static constexpr size_t MAX_EVENTS = MAX_SUBSCRIBERS * MAX_PENDING_EVENTS;
+  event_t events[MAX_EVENTS];
+  etl::queue<size_t, MAX_EVENTS> free_events;
+  for (size_t i = 0; i < MAX_EVENTS; ++i) {
+    free_events.push(i);
+  }
+
+  auto header_of = [&](topic_t topic, size_t subscriber) {
+    auto t = static_cast<size_t>(topic);
+    for (size_t i = 0; i < num_subscriptions[t]; ++i) {
+      if (subscriptions[t][i].subscriber == subscriber) {
+        return subscriptions[t][i].header;
+      }
+    }
+    __builtin_unreachable();
+  };
+
+  auto try_deliver = [&](size_t s) {
+    auto &sub = subscribers[s];
+    if (!sub.courier_ready || sub.events.empty()) {
+      return;
+    }
+    size_t e = sub.events.front();
+    sub.events.pop();
+    auto &event = events[e];
+    delivery_t delivery;
+    delivery.to = sub.tid;
+    delivery.header = header_of(event.topic, s);
+    __builtin_memcpy(delivery.data, event.data, event.len);
+    ReplyValue(sub.courier, delivery, offsetof(delivery_t, data) + event.len);
+    sub.courier_ready = false;
+    if (!--event.refs) {
+      free_events.push(e);
+    }
+  };
+
+  utils::enumed_class<pubsub_msg_header, publish_msg> msg;
+  tid_t request_tid;
+
+  while (1) {
+    int len = ReceiveValue(request_tid, msg);
+    if (len < static_cast<int>(sizeof msg.header)) {
+      continue;
+    }
+    switch (msg.header) {
+    case pubsub_msg_header::PUBLISH: {
+      // the publisher never waits for the subscribers
+      ReplyValue(request_tid, null_reply);
+      auto &publish = msg.data;
+      auto t = static_cast<size_t>(publish.topic);
+      int event_len = len - static_cast<int>(offsetof(decltype(msg), data) + offsetof(publish_msg, data));
+      if (t >= NUM_TOPICS || event_len < 0 || !num_subscriptions[t]) {
+        break;
+      }
+      if (free_events.empty()) {
+        // only when the queue of every subscriber is full
+        for (size_t i = 0; i < num_subscriptions[t]; ++i) {
+          ++subscribers[subscriptions[t][i].subscriber].dropped;
+        }
+        break;
+      }
+      size_t e = free_events.front();
+      free_events.pop();
+      auto &event = events[e];
+      event.topic = publish.topic;
+      event.len = event_len;
+      __builtin_memcpy(event.data, publish.data, event_len);
+      event.refs = 0;
+      for (size_t i = 0; i < num_subscriptions[t]; ++i) {
+        auto &sub = subscribers[subscriptions[t][i].subscriber];
+        if (sub.events.full()) {
+          ++sub.dropped;
+          continue;
+        }
+        sub.events.push(e);
+        ++event.refs;
+      }
+      if (!event.refs) {
+        free_events.push(e);
+      }
+      for (size_t i = 0; i < num_subscriptions[t]; ++i) {
+        try_deliver(subscriptions[t][i].subscriber);
+      }
+      break;
+    }
+    case pubsub_msg_header::SUBSCRIBE: {
+      auto &subscribe = msg.data_as<subscribe_msg>();
+      auto t = static_cast<size_t>(subscribe.topic);
+      int reply = -1;
+      if (t < NUM_TOPICS) {
+        size_t s = 0;
+        while (s < num_subscribers && subscribers[s].tid != request_tid) {
+          ++s;
+        }
+        if (s == num_subscribers && num_subscribers < MAX_SUBSCRIBERS) {
+          int courier = Create(priority_t::PRIORITY_L2, pubsub_courier, STACK_SMALL);
+          if (courier > 0) {
+            subscribers[s].tid = request_tid;
+            subscribers[s].courier = courier;
+            ++num_subscribers;
+          }
+        }
+        if (s < num_subscribers) {
+          size_t i = 0;
+          while (i < num_subscriptions[t] && subscriptions[t][i].subscriber != s) {
+            ++i;
+          }
+          if (i == num_subscriptions[t]) {
+            ++num_subscriptions[t];
+          }
+          subscriptions[t][i] = {s, subscribe.header};
+          reply = 0;
+        }
+      }
+      ReplyValue(request_tid, reply);
+      break;
+    }
+    case pubsub_msg_header::COURIER_READY: {
+      for (size_t s = 0; s < num_subscribers; ++s) {
+        if (subscribers[s].courier == request_tid) {
+          subscribers[s].courier_ready = true;
+          try_deliver(s);
+          break;
+        }
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+void init_tasks() {
+  Create(priority_t::PRIORITY_L1, pubsub_server, STACK_MEDIUM);
+}
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include "kstddefs.hpp"
+#include "user_syscall_typed.hpp"
+#include "../generic/utils.hpp"
+
+namespace pubsub {
+
+const char * const PUBSUB_SERVER_NAME = "pubsub";
+
+enum class topic_t : uint32_t {
+  SENSOR,       // traffic::sensor_read
+  SWITCH,       // traffic::switch_cmd
+  TRAIN_STATE,  // ui::train_read
+  NUM_TOPICS,
+};
+
+static constexpr size_t NUM_TOPICS = static_cast<size_t>(topic_t::NUM_TOPICS);
+static constexpr size_t MAX_SUBSCRIBERS = 8;
+static constexpr size_t MAX_EVENT_SIZE = 120;
+// events queued for a subscriber that is still busy with an earlier one. more are dropped
+static constexpr size_t MAX_PENDING_EVENTS = 16;
+
+enum class pubsub_msg_header : uint64_t {
+  PUBLISH,
+  SUBSCRIBE,
+  COURIER_READY,
+};
+
+struct publish_msg {
+  topic_t topic;
+  char data[MAX_EVENT_SIZE];
+};
+
+struct subscribe_msg {
+  topic_t topic;
+  uint64_t header;
+};
+
+/**
+ * fans events of each topic out to their subscribers. every subscriber gets a courier
+ * that delivers to it, so a publisher only ever waits for the server itself.
+ */
+void pubsub_server();
+
+/**
+ * sends data to every subscriber of topic. returns as soon as the server queued it.
+ */
+template<class T>
+int Publish(tid_t server, topic_t topic, const T &data) {
+  static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= MAX_EVENT_SIZE);
+  utils::enumed_class<pubsub_msg_header, publish_msg> msg;
+  msg.header = pubsub_msg_header::PUBLISH;
+  msg.data.topic = topic;
+  __builtin_memcpy(msg.data.data, &data, sizeof(T));
+  constexpr size_t len = offsetof(decltype(msg), data) + offsetof(publish_msg, data) + sizeof(T);
+  return SendValue(server, msg, len, null_reply);
+}
+
+/**
+ * makes the calling task receive the events of topic, as a message of header followed
+ * by the event. the subscriber must reply to each of them. subscribing again only
+ * changes the header. returns -1 if there is no room for another subscriber.
+ */
+template<class Header>
+int Subscribe(tid_t server, topic_t topic, Header header) {
+  static_assert(sizeof(Header) == sizeof(uint64_t));
+  utils::enumed_class msg {
+    pubsub_msg_header::SUBSCRIBE,
+    subscribe_msg {topic, static_cast<uint64_t>(header)},
+  };
+  int reply = -1;
+  if (SendValue(server, msg, reply) < 0) {
+    return -1;
+  }
+  return reply;
+}
+
+void init_tasks();
+
+}
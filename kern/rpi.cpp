@@ -159,38 +159,108 @@ void init_spi(uint32_t channel) {
   spi[channel]->CNTL1 = SPI_CNTL1_SI_MSB_FST;
 }
 
+// packs up to 3 bytes of sendbuf into a word of the fifo, and sends it
+static size_t spi_send_word(uint32_t channel, const char* sendbuf, size_t sendlen, size_t &sendidx) {
+  uint32_t data = 0;
+  size_t count = 0;
+
+  // prepare write data
+  for (; sendidx < sendlen && count < 24; sendidx += 1, count += 8) {
+    data |= (sendbuf[sendidx] << (16 - count));
+  }
+  data |= (count << 24);
+
+  if (sendidx < sendlen) {
+    spi[channel]->TXHOLD_REGa = data; // keep chip-select active, more to come
+  } else {
+    spi[channel]->IO_REGa = data;
+  }
+  return count;
+}
+
+// unpacks the reply to a word of count bits
+static void spi_recv_word(uint32_t channel, size_t count, char* recvbuf, size_t recvlen, size_t &recvidx) {
+  uint32_t data = spi[channel]->IO_REGa;
+
+  // process data, if needed, assume same byte count in transaction
+  size_t max = (recvlen - recvidx) * 8;
+  if (count > max) count = max;
+  for (; count > 0; recvidx += 1, count -= 8) {
+    recvbuf[recvidx] = (data >> (count - 8)) & 0xFF;
+  }
+}
+
+// the one transfer of the kernel's spi engine. it moves along in the done interrupt
+// instead of spinning, a fifo's worth of words at a time
+static constexpr size_t SPI_FIFO_DEPTH = 4;
+
+static struct {
+  uint32_t channel;
+  char *buf;
+  size_t sendlen, recvlen, sendidx, recvidx;
+  // bit counts of the words in the fifo, oldest first
+  size_t counts[SPI_FIFO_DEPTH];
+  size_t oldest, in_flight;
+  bool active;
+} transfer;
+
+// receives what has arrived and sends more. returns whether the transfer is complete
+static bool spi_pump_transfer() {
+  auto &t = transfer;
+  while (t.in_flight && !(spi[t.channel]->STAT & SPI_STAT_RX_EMPTY)) {
+    spi_recv_word(t.channel, t.counts[t.oldest], t.buf, t.recvlen, t.recvidx);
+    t.oldest = (t.oldest + 1) % SPI_FIFO_DEPTH;
+    --t.in_flight;
+  }
+  while (t.sendidx < t.sendlen && t.in_flight < SPI_FIFO_DEPTH && !(spi[t.channel]->STAT & SPI_STAT_TX_FULL)) {
+    t.counts[(t.oldest + t.in_flight) % SPI_FIFO_DEPTH] = spi_send_word(t.channel, t.buf, t.sendlen, t.sendidx);
+    ++t.in_flight;
+  }
+  return t.sendidx == t.sendlen && !t.in_flight;
+}
+
 static void spi_send_recv(uint32_t channel, const char* sendbuf, size_t sendlen, char* recvbuf, size_t recvlen) {
+  // a transfer of the engine has the bus. it is completed here, and the pending done
+  // interrupt tells the kernel afterwards
+  if (transfer.active) {
+    while (!spi_pump_transfer()) asm volatile("yield");
+  }
+
   size_t sendidx = 0;
   size_t recvidx = 0;
   while (sendidx < sendlen || recvidx < recvlen) {
-    uint32_t data = 0;
-    size_t count = 0;
-
-    // prepare write data
-    for (; sendidx < sendlen && count < 24; sendidx += 1, count += 8) {
-      data |= (sendbuf[sendidx] << (16 - count));
-    }
-    data |= (count << 24);
-
     // always need to write something, otherwise no receive
     while (spi[channel]->STAT & SPI_STAT_TX_FULL) asm volatile("yield");
-    if (sendidx < sendlen) {
-      spi[channel]->TXHOLD_REGa = data; // keep chip-select active, more to come
-    } else {
-      spi[channel]->IO_REGa = data;
-    }
+    size_t count = spi_send_word(channel, sendbuf, sendlen, sendidx);
 
     // read transaction
     while (spi[channel]->STAT & SPI_STAT_RX_EMPTY) asm volatile("yield");
-    data = spi[channel]->IO_REGa;
+    spi_recv_word(channel, count, recvbuf, recvlen, recvidx);
+  }
+}
 
-    // process data, if needed, assume same byte count in transaction
-    size_t max = (recvlen - recvidx) * 8;
-    if (count > max) count = max;
-    for (; count > 0; recvidx += 1, count -= 8) {
-      recvbuf[recvidx] = (data >> (count - 8)) & 0xFF;
-    }
+bool spi_start_transfer(size_t spi_channel, char *buf, size_t sendlen, size_t recvlen) {
+  transfer = {};
+  transfer.channel = spi_channel;
+  transfer.buf = buf;
+  transfer.sendlen = sendlen;
+  transfer.recvlen = recvlen;
+  transfer.active = true;
+  if (spi_pump_transfer()) {
+    transfer.active = false;
+    return true;
   }
+  spi[spi_channel]->CNTL1 |= SPI_CNTL1_Done_IRQ;
+  return false;
+}
+
+bool spi_continue_transfer() {
+  if (!transfer.active || !spi_pump_transfer()) {
+    return false;
+  }
+  spi[transfer.channel]->CNTL1 &= ~SPI_CNTL1_Done_IRQ;
+  transfer.active = false;
+  return true;
 }
 
 /*************** SPI ***************/
@@ -229,6 +299,17 @@ char uart_read_register(size_t spiChannel, size_t uartChannel, char reg) {
   return res[1];
 }
 
+char uart_register_address(size_t uart_channel, char reg, bool read) {
+  return (uart_channel << UART_CHANNEL_SHIFT) | (reg << UART_ADDR_SHIFT) | (read ? UART_READ_ENABLE : 0);
+}
+
+void uart_read_register(size_t spi_channel, size_t uart_channel, char reg, char *prepare, size_t len) {
+  prepare[0] = uart_register_address(uart_channel, reg, true);
+  // the uart ignores what is sent after the address, so the buffer is sent and
+  // received in place. every chunk is sent before its reply overwrites it
+  spi_send_recv(spi_channel, prepare, len + 1, prepare, len + 1);
+}
+
 static void uart_init_channel(size_t spiChannel, size_t uartChannel, size_t baudRate) {
   // set baud rate
   uart_write_register(spiChannel, uartChannel, UART_LCR, UART_LCR_DIV_LATCH_EN);
@@ -11,8 +11,12 @@ char uart_getc(size_t spiChannel, size_t uartChannel);
 void uart_putc(size_t spiChannel, size_t uartChannel, char c);
 void uart_puts(size_t spiChannel, size_t uartChannel, const char* buf, size_t blen);
 void uart_putui64(size_t spiChannel, size_t uartChannel, uint64_t n);
+#if HOST_BUILD
+#include <string.h>
+#else
 extern "C" void *memset(void *s, int c, size_t n);
 extern "C" void* memcpy(void* __restrict__ dest, const void* __restrict__ src, size_t n);
+#endif
 
 namespace rpi {
 
@@ -47,6 +51,19 @@ void uart_write_register(size_t spiChannel, size_t uartChannel, char reg, char d
 // "prepare" starts from index 1,
 void uart_write_register(size_t spi_channel, size_t uart_channel, char reg, char *prepare, size_t len);
 char uart_read_register(size_t spiChannel, size_t uartChannel, char reg);
+// reads reg len times in one transaction, for draining RHR. like the write,
+// "prepare" starts from index 1, and the bytes end up there
+void uart_read_register(size_t spi_channel, size_t uart_channel, char reg, char *prepare, size_t len);
+
+// the first byte of every register access
+char uart_register_address(size_t uart_channel, char reg, bool read);
+
+// the spi engine of the kernel: one transfer at a time that moves along in the spi interrupt.
+// buf holds a register access like prepare above, and is sent and received in place.
+// returns whether the transfer completed already
+bool spi_start_transfer(size_t spi_channel, char *buf, size_t sendlen, size_t recvlen);
+// on the spi interrupt. returns whether the transfer completed just now
+bool spi_continue_transfer();
 
 uint32_t read_gpeds();
 void set_gpeds(uint32_t gpeds);
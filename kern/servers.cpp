@@ -8,33 +8,58 @@
 #include "notifiers.hpp"
 
 void nameserver() {
-  troll::string_map<tid_t, MAX_TASK_NAME_LENGTH, MAX_NUM_TASKS> lookup;
+  // names by key. the name is kept only to refuse another name with the same key
+  struct name_entry {
+    etl::string<MAX_TASK_NAME_LENGTH> name;
+    tid_t tid;
+  };
+  etl::unordered_map<name_key_t, name_entry, MAX_NUM_TASKS> lookup;
 
-  char tid_buffer[4];
+  // the reply to the current request is sent by the next ReplyReceive
+  tid_t reply_tid = 0;
+  char reply_buffer[4];
+  size_t reply_len = 0;
 
   tid_t request_tid;
   char buffer[MAX_TASK_NAME_LENGTH + 1];
   while (1) {
     // received string is guaranteed to be null-terminated if client
-    // uses Register() or WhoIs()
-    int request = ReceiveValue(request_tid, buffer);
+    // uses Register()
+    int request = ReplyReceiveValue(reply_tid, reply_buffer, reply_len, request_tid, buffer);
+    reply_tid = 0;
     if (request > 0) {
       switch (buffer[0]) {
       case 'r': { // register
-        lookup[buffer + 1] = request_tid;
-        ReplyValue(request_tid, '1');
+        const char *name = buffer + 1;
+        name_key_t key = name_key(name);
+        reply_tid = request_tid;
+        reply_len = 1;
+        if (auto it = lookup.find(key); it != lookup.end() && it->second.name != name) {
+          reply_buffer[0] = '0'; // the key is taken
+          break;
+        }
+        auto &entry = lookup[key];
+        entry.name = name;
+        entry.tid = request_tid;
+        PublishName(key, request_tid);
+        reply_buffer[0] = '1';
         break;
       }
-      case 'w': { // who is
-        if (auto it = lookup.find(buffer + 1); it != lookup.cend()) {
-          auto target_tid = it->second;
-          tid_buffer[0] = target_tid;
-          tid_buffer[1] = target_tid >> 8;
-          tid_buffer[2] = target_tid >> 16;
-          tid_buffer[3] = target_tid >> 24;
-          ReplyValue(request_tid, tid_buffer);
+      case 'k': { // who is, by key
+        auto *bytes = reinterpret_cast<unsigned char*>(buffer + 1);
+        name_key_t key = bytes[0] + (bytes[1] << 8) + (bytes[2] << 16) + (bytes[3] << 24);
+        reply_tid = request_tid;
+        if (auto it = lookup.find(key); request == 5 && it != lookup.cend()) {
+          auto target_tid = it->second.tid;
+          // it may have been evicted by another name in its slot
+          PublishName(key, target_tid);
+          reply_buffer[0] = target_tid;
+          reply_buffer[1] = target_tid >> 8;
+          reply_buffer[2] = target_tid >> 16;
+          reply_buffer[3] = target_tid >> 24;
+          reply_len = 4;
         } else {
-          ReplyValue(request_tid, null_reply); // no such name
+          reply_len = 0; // no such name
         }
         break;
       }
@@ -161,78 +186,166 @@ void rpsserver() {
   }
 }
 
+namespace {
+#if TICKLESS
+  uint64_t read_timer_64() {
+    uint32_t hi, lo;
+    do {
+      hi = GET_TIMER_COUNT_HI();
+      lo = GET_TIMER_COUNT();
+    } while (hi != GET_TIMER_COUNT_HI());
+    return (uint64_t{hi} << 32) | lo;
+  }
+#endif
+
+  // a task waiting on the clock server, and whether it wants its reply in microseconds
+  struct clock_waiter {
+    tid_t tid;
+    bool in_us;
+  };
+}  // namespace
+
 void clockserver() {
   if (RegisterAs("clock_server") != 0) {
     // something went wrong in registration
     return;
   }
 
+  // the delay queue is keyed on ticks in periodic mode, where every notify is one tick.
+  // in tickless mode it is keyed on the system timer, ticks are derived from the 64 bit
+  // timer, and the kernel is asked for an alarm at the earliest deadline.
+#if TICKLESS
+  uint64_t start_time = read_timer_64();
+  auto current_tick = [start_time] {
+    return static_cast<uint32_t>((read_timer_64() - start_time) / TIMER_INTERRUPT_INTERVAL);
+  };
+  // key of the moment the tick starts
+  auto tick_key = [start_time] (uint32_t tick) -> uint32_t {
+    return start_time + uint64_t{tick} * TIMER_INTERRUPT_INTERVAL;
+  };
+  auto time_key = [] (uint32_t time) { return time; };
+  auto current_key = [] () -> uint32_t { return GET_TIMER_COUNT(); };
+  bool alarm_pending = false;
+  uint32_t alarm = 0;
+#else
   uint32_t ticks_in_10ms = 0;
-  // tid -> target tick
-  etl::unordered_map<tid_t, uint32_t, MAX_NUM_TASKS> delays;
+  // when the notify of the current tick arrived
+  uint32_t tick_start = GET_TIMER_COUNT();
+  auto current_tick = [&ticks_in_10ms] { return ticks_in_10ms; };
+  auto tick_key = [] (uint32_t tick) { return tick; };
+  // the first tick whose notify arrives at or after time, counted from the start of the
+  // current tick. ticks are only as regular as the notifies, so it may be early by the
+  // jitter of their delivery, but never by a whole tick
+  auto time_key = [&ticks_in_10ms, &tick_start] (uint32_t time) -> uint32_t {
+    uint32_t since_start = time - tick_start;
+    return ticks_in_10ms + (since_start + TIMER_INTERRUPT_INTERVAL - 1) / TIMER_INTERRUPT_INTERVAL;
+  };
+  auto current_key = [&ticks_in_10ms] { return ticks_in_10ms; };
+#endif
+  troll::deadline_queue<clock_waiter, MAX_NUM_TASKS> delays;
 
   utils::enumed_class<CLOCK_MESSAGE, uint32_t> message;
 
+  // the reply to the current request is sent by the next ReplyReceive
+  tid_t reply_tid = 0;
+  utils::enumed_class<CLOCK_REPLY, uint32_t> reply;
+
   tid_t request_tid;
   while (1) {
-    int request = ReceiveValue(request_tid, message);
+    int request = ReplyReceiveValue(reply_tid, reply, sizeof reply, request_tid, message);
+    reply_tid = 0;
     if (request <= 0) continue;
     switch (message.header) {
       case CLOCK_MESSAGE::TIME: {
-        ReplyValue(request_tid, utils::enumed_class {
-          CLOCK_REPLY::TIME_OK,
-          ticks_in_10ms,
-        });
+        reply_tid = request_tid;
+        reply = {CLOCK_REPLY::TIME_OK, current_tick()};
+        break;
+      }
+      case CLOCK_MESSAGE::TIME_US: {
+        reply_tid = request_tid;
+        reply = {CLOCK_REPLY::TIME_OK, GET_TIMER_COUNT() / NUM_TICKS_IN_1US};
         break;
       }
       case CLOCK_MESSAGE::DELAY: {
         uint32_t delay = message.data;
         if (delay > 0) {
-          delays[request_tid] = delay;
+          delays.push(tick_key(current_tick() + delay), {request_tid, false});
         } else {
-          ReplyValue(request_tid, utils::enumed_class {
-            CLOCK_REPLY::DELAY_OK,
-            ticks_in_10ms,
-          });
+          reply_tid = request_tid;
+          reply = {CLOCK_REPLY::DELAY_OK, current_tick()};
+        }
+        break;
+      }
+      case CLOCK_MESSAGE::DELAY_US: {
+        uint32_t delay = message.data * NUM_TICKS_IN_1US;
+        uint32_t now = GET_TIMER_COUNT();
+        if (delay > 0) {
+          delays.push(time_key(now + delay), {request_tid, true});
+        } else {
+          reply_tid = request_tid;
+          reply = {CLOCK_REPLY::DELAY_OK, now / NUM_TICKS_IN_1US};
         }
         break;
       }
       case CLOCK_MESSAGE::DELAY_UNTIL: {
         uint32_t delay_until = message.data;
-        int delay = delay_until - ticks_in_10ms;
+        int delay = delay_until - current_tick();
         if (delay > 0) {
-          delays[request_tid] = delay;
+          delays.push(tick_key(delay_until), {request_tid, false});
         } else if (delay == 0) {
-          ReplyValue(request_tid, utils::enumed_class {
-            CLOCK_REPLY::DELAY_OK,
-            ticks_in_10ms,
-          });
+          reply_tid = request_tid;
+          reply = {CLOCK_REPLY::DELAY_OK, current_tick()};
         } else {
-          ReplyValue(request_tid, CLOCK_REPLY::DELAY_NEGATIVE);
+          reply_tid = request_tid;
+          reply = {CLOCK_REPLY::DELAY_NEGATIVE, current_tick()};
+        }
+        break;
+      }
+      case CLOCK_MESSAGE::DELAY_UNTIL_US: {
+        uint32_t delay_until = message.data * NUM_TICKS_IN_1US;
+        uint32_t now = GET_TIMER_COUNT();
+        int32_t delay = delay_until - now;
+        if (delay > 0) {
+          delays.push(time_key(delay_until), {request_tid, true});
+        } else if (delay == 0) {
+          reply_tid = request_tid;
+          reply = {CLOCK_REPLY::DELAY_OK, now / NUM_TICKS_IN_1US};
+        } else {
+          reply_tid = request_tid;
+          reply = {CLOCK_REPLY::DELAY_NEGATIVE, now / NUM_TICKS_IN_1US};
         }
         break;
       }
       case CLOCK_MESSAGE::NOTIFY: {
+#if TICKLESS
+        alarm_pending = false;
+#else
         ++ticks_in_10ms;
-        ReplyValue(request_tid, CLOCK_REPLY::NOTIFY_OK);
-
-        // instead of removing them from the map, simply assume that
-        // delay == 0 means a null state
-        for (auto &&[tid, delay] : delays) {
-          if (delay == 0) {
-            continue;
-          }
-          delays[tid] -= 1;
-          if (delays[tid] == 0) {
-            ReplyValue(tid, utils::enumed_class {
-              CLOCK_REPLY::DELAY_OK,
-              ticks_in_10ms,
-            });
-          }
+        tick_start = GET_TIMER_COUNT();
+#endif
+        reply_tid = request_tid;
+        reply = {CLOCK_REPLY::NOTIFY_OK, current_tick()};
+
+        // only the tasks whose deadline is reached are touched
+        while (delays.expired(current_key())) {
+          auto &waiter = delays.top().value;
+          ReplyValue(waiter.tid, utils::enumed_class {
+            CLOCK_REPLY::DELAY_OK,
+            waiter.in_us ? GET_TIMER_COUNT() / NUM_TICKS_IN_1US : current_tick(),
+          });
+          delays.pop();
         }
         break;
       }
       default: break;
     }
+
+#if TICKLESS
+    if (!delays.empty() && (!alarm_pending || delays.before(delays.top().deadline, alarm))) {
+      alarm = delays.top().deadline;
+      alarm_pending = true;
+      SetAlarm(alarm);
+    }
+#endif
   }
 }
@@ -33,6 +33,10 @@ enum class CLOCK_MESSAGE : char {
   TIME,
   DELAY,
   DELAY_UNTIL,
+  // same as above, in system timer microseconds
+  TIME_US,
+  DELAY_US,
+  DELAY_UNTIL_US,
 };
 
 enum class CLOCK_REPLY : char {
@@ -63,6 +67,14 @@ struct uart_puts_message {
   char data[MAX_UART_MESSAGE_SIZE];
 };
 
+// what an rx notifier takes from the kernel with one AwaitEventBuffer()
+static constexpr size_t MAX_UART_RX_BATCH = 64;
+
+struct uart_rx_batch {
+  uint64_t data_size;
+  char data[MAX_UART_RX_BATCH];
+};
+
 enum class UART_REPLY : char {
   OK = 'o',
 };
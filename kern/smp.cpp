@@ -0,0 +1,96 @@
+#include "smp.hpp"
+
+#if SMP
+#include "irq.hpp"
+
+extern "C" void secondary_start();
+
+namespace {
+
+// the firmware parks core n polling this address until it holds where to jump to
+constexpr uintptr_t SPIN_TABLE_BASE = 0xd8;
+
+// the sgi other cores send to make one schedule again
+constexpr uint32_t RESCHEDULE_SGI = 0;
+
+inline void barrier() {
+  asm volatile("dmb sy" ::: "memory");
+}
+
+// lamport's bakery lock. with the mmu off (MMU=0, or after a benchmark syscall) every data
+// access is to device memory, where exclusive loads and stores are not guaranteed to work,
+// so the lock cannot use atomics
+class bakery_lock {
+public:
+  void lock(size_t core) {
+    choosing[core] = true;
+    barrier();
+    uint32_t ticket = 0;
+    for (size_t c = 0; c < NUM_CORES; ++c) {
+      if (number[c] > ticket) {
+        ticket = number[c];
+      }
+    }
+    number[core] = ticket + 1;
+    barrier();
+    choosing[core] = false;
+    barrier();
+    for (size_t c = 0; c < NUM_CORES; ++c) {
+      while (choosing[c]) {
+      }
+      // wait for every core with a smaller ticket, ties going to the lower core
+      while (number[c] && (number[c] < number[core] || (number[c] == number[core] && c < core))) {
+      }
+    }
+    barrier();
+  }
+
+  void unlock(size_t core) {
+    barrier();
+    number[core] = 0;
+  }
+
+private:
+  volatile bool choosing[NUM_CORES] {};
+  volatile uint32_t number[NUM_CORES] {};
+};
+
+bakery_lock kernel_lock;
+
+}  // namespace
+
+namespace kernel {
+
+size_t core_id() {
+  uint64_t mpidr;
+  asm volatile("mrs %x0, mpidr_el1" : "=r"(mpidr));
+  return mpidr & 3;
+}
+
+void start_secondary_cores() {
+  for (size_t core = 1; core < NUM_CORES; ++core) {
+    auto entry = reinterpret_cast<volatile uint64_t *>(SPIN_TABLE_BASE + 8 * core);
+    *entry = reinterpret_cast<uint64_t>(secondary_start);
+    // the spinning core reads ram with its mmu off, past our data cache
+    asm volatile("dc civac, %x0" :: "r"(entry) : "memory");
+  }
+  asm volatile("dsb sy");
+  asm volatile("sev");
+}
+
+void wake_cores(affinity_t core_mask) {
+  if (core_mask) {
+    irq::send_sgi(core_mask, RESCHEDULE_SGI);
+  }
+}
+
+void lock_kernel(size_t core) {
+  kernel_lock.lock(core);
+}
+
+void unlock_kernel(size_t core) {
+  kernel_lock.unlock(core);
+}
+
+}  // namespace kernel
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "kstddefs.hpp"
+
+// bringing up the other cores, and what the kernel loops of all cores need to get along.
+// without SMP there is only core 0 and all of this does nothing
+namespace kernel {
+
+#if SMP
+// the core running this code
+size_t core_id();
+
+// releases the other cores from the spin table of the firmware into secondary_start in boot.S
+void start_secondary_cores();
+
+// interrupts the cores in core_mask with the reschedule sgi
+void wake_cores(affinity_t core_mask);
+
+// kernel code runs on one core at a time
+void lock_kernel(size_t core);
+void unlock_kernel(size_t core);
+#else
+inline size_t core_id() {
+  return 0;
+}
+
+inline void wake_cores(affinity_t) {}
+inline void lock_kernel(size_t) {}
+inline void unlock_kernel(size_t) {}
+#endif
+
+}  // namespace kernel
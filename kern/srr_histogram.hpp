@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../generic/containers.hpp"
+#include "kstddefs.hpp"
+
+static constexpr size_t NUM_SRR_LATENCY_BUCKETS = 24;  // the last one starts at ~4s
+static constexpr size_t MAX_SRR_PAIRS = 64;
+
+// round trip latencies of Send()s from sender until receiver replied, in timer ticks.
+// only recorded in BENCHMARKING builds
+struct srr_histogram_t {
+  tid_t sender;
+  tid_t receiver;
+  troll::log2_histogram<NUM_SRR_LATENCY_BUCKETS> latency;
+};
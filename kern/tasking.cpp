@@ -2,72 +2,289 @@
 #include "../user.hpp"
 #include "kernel.hpp"
 #include "rpi.hpp"
+#include "irq.include"
+#include "smp.hpp"
+
+extern "C" void save_fp_context(volatile kernel::fp_context_t *fp);
+extern "C" void load_fp_context(volatile kernel::fp_context_t *fp);
+extern "C" void reset_fp_context();
+extern "C" void set_fp_trap(bool trap);
+extern "C" void set_full_frames(bool full);
 
 using namespace kernel;
 
 namespace {
 
+// unused stack memory holds this pattern, so the high water mark is the lowest word that does not
+constexpr uint64_t STACK_PAINT = 0xBAD0BAD0BAD0BAD0;
+// below the lowest stack pointer seen at a kernel entry, the words a task used in between
+// end at the first run of this many words of paint
+constexpr size_t STACK_PAINT_RUN = 256;
+
+void paint_stack(char *from, size_t n) {
+  auto *word = reinterpret_cast<uint64_t *>(from);
+  for (size_t i = 0; i < n / sizeof(uint64_t); ++i) {
+    word[i] = STACK_PAINT;
+  }
+}
+
+// stores the first n bytes of a short message held in w0 and w1 into dest
+void store_short_message(char* dest, size_t n, uint64_t w0, uint64_t w1) {
+  size_t i = 0;
+  if (!(reinterpret_cast<uintptr_t>(dest) & 7)) {
+    for (; i + 8 <= n; i += 8) {
+      *reinterpret_cast<uint64_t*>(dest + i) = i ? w1 : w0;
+    }
+  }
+  for (; i < n; ++i) {
+    dest[i] = static_cast<char>(i < 8 ? w0 >> (i * 8) : w1 >> ((i - 8) * 8));
+  }
+}
+
+size_t short_message_length(int64_t len) {
+  return len > static_cast<int64_t>(MAX_SHORT_MESSAGE_SIZE) ? MAX_SHORT_MESSAGE_SIZE : len;
+}
+
 void send_message(task_descriptor* sender, task_descriptor* receiver) {
   tid_t sender_tid = sender->tid;
-  const char* src = reinterpret_cast<const char*>(sender->context.registers[1]);
-  size_t srclen = sender->context.registers[2];
 
   tid_t* tid = reinterpret_cast<tid_t*>(receiver->context.registers[0]);
   char* dest = reinterpret_cast<char*>(receiver->context.registers[1]);
-  size_t destlen = sender->context.registers[2];
+  size_t destlen = receiver->context.registers[2];
 
-  size_t n = srclen > destlen ? destlen : srclen;
-  memcpy(dest, src, n);
+  size_t n;
+  if (sender->message_in_registers) {
+    size_t srclen = short_message_length(sender->context.registers[3]);
+    n = srclen > destlen ? destlen : srclen;
+    store_short_message(dest, n, sender->context.registers[1], sender->context.registers[2]);
+  } else {
+    const char* src = reinterpret_cast<const char*>(sender->context.registers[1]);
+    size_t srclen = sender->context.registers[2];
+    n = srclen > destlen ? destlen : srclen;
+    memcpy(dest, src, n);
+  }
   *tid = sender_tid;
   receiver->context.registers[0] = n;
-  sender->state = task_state_t::ReplyWait;
 }
 
-void reply_message(task_descriptor* sender, task_descriptor *replier) {
-  const char* src = reinterpret_cast<const char*>(replier->context.registers[1]);
-  size_t srclen = replier->context.registers[2];
+void reply_message(task_descriptor* sender, task_descriptor *replier, bool short_reply) {
+  int reply_reg = sender->message_in_registers ? 4 : 3;
+  char* dest = reinterpret_cast<char *>(sender->context.registers[reply_reg]);
+  size_t destlen = sender->context.registers[reply_reg + 1];
 
-  char* dest = reinterpret_cast<char *>(sender->context.registers[3]);
-  size_t destlen = sender->context.registers[4];
-
-  size_t n = srclen > destlen ? destlen : srclen;
-  memcpy(dest, src, n);
+  size_t n;
+  if (short_reply) {
+    size_t srclen = short_message_length(replier->context.registers[3]);
+    n = srclen > destlen ? destlen : srclen;
+    store_short_message(dest, n, replier->context.registers[1], replier->context.registers[2]);
+  } else {
+    const char* src = reinterpret_cast<const char*>(replier->context.registers[1]);
+    size_t srclen = replier->context.registers[2];
+    n = srclen > destlen ? destlen : srclen;
+    memcpy(dest, src, n);
+  }
 
   replier->context.registers[0] = n;
   sender->context.registers[0] = n;
 }
 }; // namespace
 
-task_descriptor *task_manager::new_task(tid_t parent_tid, size_t parent_generation, priority_t priority, task_state_t state) {
+task_manager::task_manager() {
+  // once, before any interrupt can wait for it. freed stacks are only repainted as far
+  // as their last task used them
+  paint_stack(stack_buff, TOTAL_STACK_SIZE);
+}
+
+task_descriptor *task_manager::new_task(tid_t parent_tid, priority_t priority,
+                                         stack_class_t stack_class, task_state_t state) {
   auto *task = allocator.allocate();
   auto i = allocator.index_of(task);
-  // tid starts at 2 for tasks
-  task->tid = i + STARTING_TASK_TID;
+  task->tid = make_tid(i, task_reuse_statuses[i].gen++);
   task->parent_tid = parent_tid;
   task->priority = priority;
+  task->base_priority = priority;
+#if PRIORITY_INHERITANCE
+  task->blocked_on = 0;
+  for (auto &count : task->waiters) {
+    count = 0;
+  }
+#endif
   task->state = state;
+  task->state_since = now;
+  task->stack_class = stack_class;
+  task->fp_used = false;
+  task->period = 0;
 
-  task_reuse_statuses[i].gen++;
-  task_reuse_statuses[i].parent_gen = parent_generation;
-  task_reuse_statuses[i].free = 0;
-  // point to end of stack space since it grows backward
-  task->context.stack_pointer = reinterpret_cast<uint64_t>(stack_buff + (i + 1) * TASK_STACK_SIZE);
+  task_reuse_statuses[i].tid = task->tid;
+  allocate_stack(task);
+  // the first dispatch takes the syscall frame, like the return from Create(). the
+  // registers it does not restore are cleared by kernel_to_task
+  for (auto &reg : task->context.registers) {
+    reg = 0;
+  }
+  task->context.full_frame = 0;
   task->context.spsr = 0; // make sure to not mask irq
   return task;
 }
 
-task_descriptor *task_manager::get_task() {
-  return ready.size() ? &ready.pop() : nullptr;
+bool task_manager::has_free_stack(stack_class_t stack_class) const {
+  return num_free_stacks[stack_class] || num_used_stacks[stack_class] < STACK_CLASS_COUNTS[stack_class];
+}
+
+char *task_manager::stack_bottom(stack_class_t stack_class, size_t slot) {
+  size_t offset = 0;
+  for (size_t c = 0; c < stack_class; ++c) {
+    offset += STACK_CLASS_SIZES[c] * STACK_CLASS_COUNTS[c];
+  }
+  return stack_buff + offset + slot * STACK_CLASS_SIZES[stack_class];
+}
+
+void task_manager::allocate_stack(task_descriptor *task) {
+  auto stack_class = task->stack_class;
+  size_t size = STACK_CLASS_SIZES[stack_class];
+  size_t slot, dirty;
+  if (num_free_stacks[stack_class]) {
+    slot = free_stacks[stack_class][--num_free_stacks[stack_class]];
+    dirty = stack_dirty_bytes[stack_class][slot];
+  } else {
+    // first use, painted along with the whole pool
+    slot = num_used_stacks[stack_class]++;
+    dirty = 0;
+  }
+  char *bottom = stack_bottom(stack_class, slot);
+  paint_stack(bottom + size - dirty, dirty);
+  task->stack_slot = slot;
+  task->context.stack_limit = reinterpret_cast<uint64_t>(bottom);
+  // point to end of stack space since it grows backward
+  task->context.stack_pointer = reinterpret_cast<uint64_t>(bottom + size);
+  task->lowest_sp = task->context.stack_pointer;
+}
+
+void task_manager::free_stack(task_descriptor *task) {
+  auto stack_class = task->stack_class;
+  stack_dirty_bytes[stack_class][task->stack_slot] = stack_high_water(task);
+  free_stacks[stack_class][num_free_stacks[stack_class]++] = task->stack_slot;
+}
+
+size_t task_manager::stack_high_water(task_descriptor *task) {
+  // only the used part is read, from the lowest stack pointer down. the unused part
+  // below can be megabytes, and this runs with interrupts masked
+  auto *bottom = reinterpret_cast<const uint64_t *>(task->context.stack_limit);
+  auto *word = reinterpret_cast<const uint64_t *>(task->lowest_sp & ~uint64_t{7});
+  auto *lowest = word;
+  size_t run = 0;
+  while (word > bottom && run < STACK_PAINT_RUN) {
+    --word;
+    if (*word == STACK_PAINT) {
+      ++run;
+    } else {
+      run = 0;
+      lowest = word;
+    }
+  }
+  return task->context.stack_limit + STACK_CLASS_SIZES[task->stack_class] - reinterpret_cast<uint64_t>(lowest);
+}
+
+task_descriptor *task_manager::task_of(tid_t tid) {
+  size_t i = tid_index(tid);
+  if (i >= MAX_NUM_TASKS || task_reuse_statuses[i].tid != tid) {
+    return nullptr;
+  }
+  return allocator.at(i);
+}
+
+task_descriptor *task_manager::get_task(size_t core) {
+#if SMP
+  // an idle core steals the most urgent task of another core that may run here.
+  // idle tasks stay on their core, since they would keep the thief from sleeping
+  for (size_t i = 1; i < NUM_CORES && !ready[core].size(); ++i) {
+    auto &victim = ready[(core + i) % NUM_CORES];
+    if (!victim.size()) {
+      continue;
+    }
+    auto [task, priority] = victim.front_tuple();
+    // the fp/simd state of the task might still be in the registers of the victim
+    if (priority != PRIORITY_IDLE && (task.affinity & (1u << core)) && fp_owner[task.core] != &task) {
+      victim.pop();
+      task.core = core;
+      queue_ready(&task, core, static_cast<priority_t>(priority));
+    }
+  }
+  if (!ready[core].size()) {
+    idle_cores |= 1u << core;
+    return nullptr;
+  }
+  idle_cores &= ~(1u << core);
+  auto *task = &ready[core].pop();
+  if (!(task->affinity & (1u << core))) {
+    // it only waited here for its fp/simd registers to be saved
+    flush_fp(task);
+    ready_push(task);
+    return get_task(core);
+  }
+#else
+  if (!ready[core].size()) {
+    return nullptr;
+  }
+  auto *task = &ready[core].pop();
+#endif
+  set_state(task, task_state_t::Active);
+  return task;
 }
 
 void task_manager::ready_push(task_descriptor *task) {
-  task->state = task_state_t::Ready;
-  ready.push(*task, task->priority);
+  set_state(task, task_state_t::Ready);
+#if SMP
+  // a task with its fp/simd state in the registers of its core waits there until the core saves it
+  if (!(task->affinity & (1u << task->core)) && fp_owner[task->core] != task) {
+    task->core = __builtin_ctz(task->affinity);
+  }
+  queue_ready(task, task->core, task->priority);
+  // the core of the task might be running something less urgent, and idle cores
+  // might steal it. this core schedules again on its own before leaving the kernel
+  wake_cores(((1u << task->core) | (idle_cores & task->affinity)) & ~(1u << core_id()));
+#else
+  queue_ready(task, task->core, task->priority);
+#endif
+}
+
+void task_manager::queue_ready(task_descriptor *task, size_t core, priority_t priority) {
+  if (!task->period) {
+    ready[core].push(*task, priority);
+    return;
+  }
+  ready[core].push_ordered(*task, priority, [](task_descriptor &a, task_descriptor &b) {
+    return !b.period || release_queue::before(a.deadline, b.deadline);
+  });
+}
+
+void task_manager::set_state(task_descriptor *task, task_state_t state) {
+  task->profile.state_ticks[static_cast<size_t>(task->state)] += now - task->state_since;
+  task->state_since = now;
+  task->state = state;
+}
+
+void task_manager::set_time(uint32_t now) {
+  this->now = now;
+}
+
+void task_manager::record_activation(task_descriptor *task, uint32_t run_ticks, uint32_t request) {
+  auto &profile = task->profile;
+  profile.run_ticks += run_ticks;
+  if (task->context.stack_pointer < task->lowest_sp) {
+    task->lowest_sp = task->context.stack_pointer;
+  }
+  ++profile.dispatches;
+  if (request < SYSCALLN_INVALID) {
+    ++profile.syscalls[request];
+  } else if (request == IRQ) {
+    ++profile.interrupts;
+  }
 }
 
 void task_manager::k_create(task_descriptor *curr_task) {
   // when the current task calls this syscall
-  // x0 holds priority, and x1 holds the function pointer
+  // x0 holds priority, x1 holds the function pointer, and x2 the stack class
 
   // check priority
   auto priority = static_cast<priority_t>(curr_task->context.registers[0]);
@@ -77,13 +294,23 @@ void task_manager::k_create(task_descriptor *curr_task) {
     return;
   }
 
+  auto stack_class = static_cast<stack_class_t>(curr_task->context.registers[2]);
+  if (!(STACK_SMALL <= stack_class && stack_class < NUM_STACK_CLASSES)) {
+    curr_task->context.registers[0] = -1;
+    ready_push(curr_task);
+    return;
+  }
+
   // check whether one can still allocate new task
-  if (allocator.num_allocated() == allocator.capacity) {
+  if (allocator.num_allocated() == allocator.capacity || !has_free_stack(stack_class)) {
     curr_task->context.registers[0] = -2;
     ready_push(curr_task);
     return;
   }
-  auto *new_task = this->new_task(curr_task->tid, task_reuse_statuses[curr_task->tid - 2].gen, priority);
+  auto *new_task = this->new_task(curr_task->tid, priority, stack_class);
+  // children start out where their parent runs
+  new_task->affinity = curr_task->affinity;
+  new_task->core = curr_task->core;
   new_task->context.exception_lr = reinterpret_cast<uint64_t>(task_wrapper);
   new_task->context.registers[0] = curr_task->context.registers[1]; // the actual function
 
@@ -103,15 +330,9 @@ void task_manager::k_my_tid(task_descriptor *curr_task) {
 void task_manager::k_my_parent_tid(task_descriptor *curr_task) {
   tid_t parent_tid = curr_task->parent_tid;
 
-  if (parent_tid != KERNEL_TID) {
-    // the parent task might have exited
-    size_t parent_index = parent_tid - STARTING_TASK_TID;
-    size_t curr_index = curr_task->tid - STARTING_TASK_TID;
-    // if the parent descriptor is free, or if the generations do not match, then it must be that
-    // the parent task has already exited
-    if (task_reuse_statuses[parent_index].free || task_reuse_statuses[parent_index].gen != task_reuse_statuses[curr_index].parent_gen) {
-      parent_tid |= EXITED_PARENT_MASK;
-    }
+  // the parent task might have exited, in which case its descriptor is free or has another tid
+  if (parent_tid != KERNEL_TID && !task_of(parent_tid)) {
+    parent_tid |= EXITED_PARENT_MASK;
   }
 
   curr_task->context.registers[0] = parent_tid;
@@ -123,13 +344,31 @@ void task_manager::k_yield(task_descriptor *curr_task) {
 }
 
 void task_manager::k_exit(task_descriptor *curr_task) {
-  task_reuse_statuses[curr_task->tid - STARTING_TASK_TID].free = 1;
-  curr_task->state = task_state_t::Free; // not needed but for good measures
+  // its fp/simd state can be overwritten without saving it
+  if (fp_owner[curr_task->core] == curr_task) {
+    fp_owner[curr_task->core] = nullptr;
+  }
+  task_reuse_statuses[tid_index(curr_task->tid)].tid = 0;
+  set_state(curr_task, task_state_t::Free); // not needed but for good measures
+  free_stack(curr_task);
   allocator.free(curr_task);
 }
 
 void task_manager::k_send(task_descriptor *curr_task) {
+  curr_task->message_in_registers = false;
+  send(curr_task);
+}
+
+void task_manager::k_send_short(task_descriptor *curr_task) {
+  curr_task->message_in_registers = true;
+  send(curr_task);
+}
+
+void task_manager::send(task_descriptor *curr_task) {
   tid_t target_tid = curr_task->context.registers[0];
+#if BENCHMARKING
+  curr_task->send_time = GET_TIMER_COUNT();
+#endif
 
   // SRR cannot be completed, a task cannot send itself a message
   if (target_tid == curr_task->tid) {
@@ -138,8 +377,8 @@ void task_manager::k_send(task_descriptor *curr_task) {
     return;
   }
 
-  task_descriptor* target_task = allocator.at(target_tid - STARTING_TASK_TID);
-  if (!target_task || task_reuse_statuses[target_tid - STARTING_TASK_TID].free) {
+  task_descriptor* target_task = task_of(target_tid);
+  if (!target_task) {
     // invalid tid, or task exited
     curr_task->context.registers[0] = -1;
     ready_push(curr_task);
@@ -148,46 +387,150 @@ void task_manager::k_send(task_descriptor *curr_task) {
 
   if (target_task->state == task_state_t::ReceiveWait) {
     send_message(curr_task, target_task);
+    set_state(curr_task, task_state_t::ReplyWait);
+#if PRIORITY_INHERITANCE
+    add_waiter(curr_task, target_task);
+#endif
     ready_push(target_task);
     return;
   }
 
-  curr_task->state = task_state_t::SendWait;
-  mailboxes[target_tid - STARTING_TASK_TID].push(*curr_task);
+  set_state(curr_task, task_state_t::SendWait);
+  mailboxes[tid_index(target_tid)].push(*curr_task);
+#if PRIORITY_INHERITANCE
+  add_waiter(curr_task, target_task);
+#endif
 }
 
 void task_manager::k_receive(task_descriptor *curr_task) {
-  if (!mailboxes[curr_task->tid - STARTING_TASK_TID].empty()) {
-    task_descriptor *sender_task = &(mailboxes[curr_task->tid - STARTING_TASK_TID].pop());
+  auto &mailbox = mailboxes[tid_index(curr_task->tid)];
+  if (!mailbox.empty()) {
+    task_descriptor *sender_task = &mailbox.pop();
     send_message(sender_task, curr_task);
+    set_state(sender_task, task_state_t::ReplyWait);
     ready_push(curr_task);
     return;
   }
 
-  curr_task->state = task_state_t::ReceiveWait;
+  set_state(curr_task, task_state_t::ReceiveWait);
 }
 
 void task_manager::k_reply(task_descriptor *curr_task) {
+  reply(curr_task, false);
+  ready_push(curr_task);
+}
+
+void task_manager::k_reply_short(task_descriptor *curr_task) {
+  reply(curr_task, true);
+  ready_push(curr_task);
+}
+
+void task_manager::k_reply_receive(task_descriptor *curr_task) {
+  // x0 to x2 hold the arguments of Reply(), and a tid of 0 skips the reply.
+  // a failed reply is not reported because receive overwrites x0 anyway
+  if (curr_task->context.registers[0]) {
+    reply(curr_task, false);
+  }
+  // x3 to x5 hold the arguments of Receive()
+  curr_task->context.registers[0] = curr_task->context.registers[3];
+  curr_task->context.registers[1] = curr_task->context.registers[4];
+  curr_task->context.registers[2] = curr_task->context.registers[5];
+  k_receive(curr_task);
+}
+
+void task_manager::reply(task_descriptor *curr_task, bool short_reply) {
   tid_t sender_tid = curr_task->context.registers[0];
-  task_descriptor* sender_task = allocator.at(sender_tid - STARTING_TASK_TID);
-  if (!sender_task || task_reuse_statuses[sender_tid - STARTING_TASK_TID].free) {
+  task_descriptor* sender_task = task_of(sender_tid);
+  if (!sender_task) {
     // invalid tid, or task exited
     curr_task->context.registers[0] = -1;
-    ready_push(curr_task);
     return;
   }
 
   if (sender_task->state != task_state_t::ReplyWait) {
     curr_task->context.registers[0] = -2;
-    ready_push(curr_task);
     return;
   }
 
-  reply_message(sender_task, curr_task);
+  reply_message(sender_task, curr_task, short_reply);
+#if BENCHMARKING
+  record_srr_latency(sender_task, curr_task->tid);
+#endif
+#if PRIORITY_INHERITANCE
+  // the replier drops back before the caller schedules it
+  remove_waiter(sender_task);
+#endif
   ready_push(sender_task);
-  ready_push(curr_task);
 }
 
+#if PRIORITY_INHERITANCE
+void task_manager::add_waiter(task_descriptor *waiter, task_descriptor *target) {
+  waiter->blocked_on = target->tid;
+  ++target->waiters[waiter->priority];
+  update_priority(target);
+}
+
+void task_manager::remove_waiter(task_descriptor *waiter) {
+  auto *target = task_of(waiter->blocked_on);
+  waiter->blocked_on = 0;
+  if (!target) {
+    // it exited, and its descriptor does not count waiters of the old task
+    return;
+  }
+  --target->waiters[waiter->priority];
+  update_priority(target);
+}
+
+void task_manager::update_priority(task_descriptor *task) {
+  // a deadlocked cycle of senders would never stop changing, so bound the walk
+  for (size_t hops = 0; hops < MAX_NUM_TASKS; ++hops) {
+    auto priority = task->base_priority;
+    for (int p = NUM_PRIORITIES - 1; p > priority; --p) {
+      if (task->waiters[p]) {
+        priority = static_cast<priority_t>(p);
+        break;
+      }
+    }
+    auto old_priority = task->priority;
+    if (priority == old_priority) {
+      return;
+    }
+    task->priority = priority;
+    if (task->state == task_state_t::Ready) {
+      // move it to the back of its new ready queue
+      ready[task->core].remove(*task, old_priority);
+      queue_ready(task, task->core, priority);
+    }
+    auto *next = task_of(task->blocked_on);
+    if (!next) {
+      return;
+    }
+    // the task it is blocked on counted it at its old priority
+    --next->waiters[old_priority];
+    ++next->waiters[priority];
+    task = next;
+  }
+}
+#endif
+
+#if BENCHMARKING
+void task_manager::record_srr_latency(task_descriptor *sender, tid_t receiver) {
+  uint32_t latency = GET_TIMER_COUNT() - sender->send_time;
+  size_t slot = (sender->tid * 31 + receiver) % MAX_SRR_PAIRS;
+  for (size_t probes = 0; probes < MAX_SRR_PAIRS; ++probes, slot = (slot + 1) % MAX_SRR_PAIRS) {
+    auto &entry = srr_histograms[slot];
+    if (!entry.sender) {
+      entry.sender = sender->tid;
+      entry.receiver = receiver;
+    }
+    if (entry.sender == sender->tid && entry.receiver == receiver) {
+      entry.latency.record(latency);
+      return;
+    }
+  }
+}
+#endif
+
 void task_manager::k_await_event(task_descriptor *curr_task, gpio::uart_interrupt_state& state) {
   events_t event_id = (events_t) (curr_task->context.registers[0]);
   // if (missed_event_queues[event_id] != 0) {
@@ -195,7 +538,22 @@ void task_manager::k_await_event(task_descriptor *curr_task, gpio::uart_interrup
   //   missed_event_queues[event_id] = 0;
   //   ready_push(curr_task);
   // }
+#if TICKLESS
+  if (event_id == events_t::TIMER && missed_alarm) {
+    missed_alarm = false;
+    curr_task->context.registers[0] = 1;
+    ready_push(curr_task);
+    return;
+  }
+#endif
+  if (event_id == events_t::UART_R0 || event_id == events_t::UART_R1) {
+    // the bytes are in the kernel buffer already. only report how many
+    curr_task->context.registers[2] = 0;
+    k_await_event_buffer(curr_task, state);
+    return;
+  }
   if (event_id < MAX_NUM_EVENTS) {
+    set_state(curr_task, task_state_t::EventWait);
     event_queues[event_id].push(*curr_task);
     switch (event_id) {
       case events_t::UART_R0: {
@@ -227,57 +585,454 @@ void task_manager::k_await_event(task_descriptor *curr_task, gpio::uart_interrup
   }
 }
 
+void task_manager::k_await_event_buffer(task_descriptor *curr_task, gpio::uart_interrupt_state& state) {
+  auto event_id = static_cast<events_t>(curr_task->context.registers[0]);
+  int buflen = curr_task->context.registers[2];
+  if ((event_id != events_t::UART_R0 && event_id != events_t::UART_R1) || buflen < 0) {
+    curr_task->context.registers[0] = -1;
+    ready_push(curr_task);
+    return;
+  }
+  size_t uart_channel = event_id == events_t::UART_R0 ? 0 : 1;
+  // the interrupt handler turns rx off while the buffer is full
+  state.enable_rx(uart_channel);
+  if (!uart_rx_buffers[uart_channel].empty()) {
+    deliver_uart_rx(curr_task, uart_channel);
+    ready_push(curr_task);
+    return;
+  }
+  set_state(curr_task, task_state_t::EventWait);
+  event_queues[event_id].push(*curr_task);
+}
+
+void task_manager::deliver_uart_rx(task_descriptor *task, size_t uart_channel) {
+  auto &buffer = uart_rx_buffers[uart_channel];
+  auto *dest = reinterpret_cast<char *>(task->context.registers[1]);
+  size_t buflen = task->context.registers[2];
+  if (!buflen) {
+    task->context.registers[0] = buffer.size();
+    return;
+  }
+  size_t n = 0;
+  for (; n < buflen && !buffer.empty(); ++n) {
+    dest[n] = buffer.pop();
+  }
+  task->context.registers[0] = n;
+}
+
+void task_manager::drain_uart_rx(size_t uart_channel, gpio::uart_interrupt_state& state) {
+  auto &buffer = uart_rx_buffers[uart_channel];
+  size_t n = uart_read_register(0, uart_channel, rpi::UART_RXLVL);
+  size_t room = buffer.capacity - buffer.size();
+  if (n > room) {
+    n = room;
+  }
+  if (n > UART_FIFO_SIZE) {
+    n = UART_FIFO_SIZE;
+  }
+  if (n) {
+    // the whole fifo in one spi transaction
+    char burst[UART_FIFO_SIZE + 1];
+    uart_read_register(0, uart_channel, rpi::UART_RHR, burst, n);
+    for (size_t i = 1; i <= n; ++i) {
+      buffer.push(burst[i]);
+    }
+  }
+  if (buffer.full()) {
+    // the fifo keeps the rest until a task makes room
+    state.disable_rx(uart_channel);
+  }
+  auto &waiters = event_queues[uart_channel ? events_t::UART_R1 : events_t::UART_R0];
+  while (waiters.size() && !buffer.empty()) {
+    auto &task = waiters.pop();
+    deliver_uart_rx(&task, uart_channel);
+    trace(trace_kind_t::WAKEUP, task.tid, uart_channel ? events_t::UART_R1 : events_t::UART_R0);
+    ready_push(&task);
+  }
+}
+
 void task_manager::wake_up_tasks_on_event(events_t event_id, int return_value) {
   auto& event_queue = event_queues[event_id];
   if (!event_queue.size()) {
     // DEBUG_LITERAL("[kernel] no task is waiting on event!\r\n");
     // missed_event_queues[event_id] = return_value;
+#if TICKLESS
+    if (event_id == events_t::TIMER) {
+      missed_alarm = true;
+    }
+#endif
   }
   while (event_queue.size()) {
     auto& task = event_queue.pop();
     task.context.registers[0] = return_value;
+    trace(trace_kind_t::WAKEUP, task.tid, event_id);
     ready_push(&task);
   }
 }
 
+// register accesses of tasks go through the spi engine. the task blocks until its
+// access is done, and the kernel runs other tasks instead of spinning on the bus
+
 void task_manager::k_uart_read(task_descriptor *curr_task) {
   int uart_channel = curr_task->context.registers[0];
   char reg = curr_task->context.registers[1];
-  char data = uart_read_register(0, uart_channel, reg);
-  curr_task->context.registers[0] = data;
-  ready_push(curr_task);
+  spi_request request {curr_task, nullptr, {uart_register_address(uart_channel, reg, true), 0}, 2, 2};
+  submit_spi(request);
 }
 
 void task_manager::k_uart_write(task_descriptor *curr_task) {
   int uart_channel = curr_task->context.registers[0];
   char reg = curr_task->context.registers[1];
   char data = curr_task->context.registers[2];
-  uart_write_register(0, uart_channel, reg, data);
-  curr_task->context.registers[0] = 0;
-  ready_push(curr_task);
+  spi_request request {curr_task, nullptr, {uart_register_address(uart_channel, reg, false), data}, 2, 0};
+  submit_spi(request);
 }
 
 void task_manager::k_uart_write_n(task_descriptor *curr_task) {
   int uart_channel = curr_task->context.registers[0];
   char reg = curr_task->context.registers[1];
   auto *data = reinterpret_cast<char *>(curr_task->context.registers[2]);
-  int len = curr_task->context.registers[3];
-  uart_write_register(0, uart_channel, reg, data, len);
+  uint32_t len = curr_task->context.registers[3];
+  data[0] = uart_register_address(uart_channel, reg, false);
+  spi_request request {curr_task, data, {}, len + 1, 0};
+  submit_spi(request);
+}
+
+void task_manager::k_uart_read_n(task_descriptor *curr_task) {
+  int uart_channel = curr_task->context.registers[0];
+  char reg = curr_task->context.registers[1];
+  auto *data = reinterpret_cast<char *>(curr_task->context.registers[2]);
+  uint32_t len = curr_task->context.registers[3];
+  data[0] = uart_register_address(uart_channel, reg, true);
+  spi_request request {curr_task, data, {}, len + 1, len + 1};
+  submit_spi(request);
+}
+
+void task_manager::submit_spi(const spi_request &request) {
+  set_state(request.task, task_state_t::EventWait);
+  spi_requests.push(request);
+  if (spi_requests.size() == 1) {
+    start_spi();
+  }
+}
+
+void task_manager::start_spi() {
+  while (!spi_requests.empty()) {
+    auto &request = spi_requests.front();
+    char *buffer = request.buffer ? request.buffer : request.short_buffer;
+    if (!spi_start_transfer(0, buffer, request.sendlen, request.recvlen)) {
+      return;
+    }
+    complete_spi();
+  }
+}
+
+void task_manager::continue_spi() {
+  if (spi_requests.empty() || !spi_continue_transfer()) {
+    return;
+  }
+  complete_spi();
+  start_spi();
+}
+
+void task_manager::complete_spi() {
+  auto request = spi_requests.pop();
+  // a single register read returns the byte, everything else 0
+  request.task->context.registers[0] = request.buffer || !request.recvlen ? 0 : request.short_buffer[1];
+  ready_push(request.task);
+}
+
+void task_manager::k_task_profile(task_descriptor *curr_task) {
+  auto *profiles = reinterpret_cast<task_profile_t *>(curr_task->context.registers[0]);
+  size_t max_profiles = curr_task->context.registers[1];
+  size_t n = 0;
+  for (size_t i = 0; i < MAX_NUM_TASKS && n < max_profiles; ++i) {
+    if (!task_reuse_statuses[i].tid) {
+      continue;
+    }
+    auto *task = allocator.at(i);
+    auto &profile = profiles[n++];
+    profile = task->profile;
+    profile.tid = task->tid;
+    profile.priority = task->priority;
+    // include the time in the current state so far
+    profile.state_ticks[static_cast<size_t>(task->state)] += now - task->state_since;
+  }
+  curr_task->context.registers[0] = n;
+  ready_push(curr_task);
+}
+
+void task_manager::k_srr_histogram(task_descriptor *curr_task) {
+  size_t n = 0;
+#if BENCHMARKING
+  auto *histograms = reinterpret_cast<srr_histogram_t *>(curr_task->context.registers[0]);
+  size_t max_histograms = curr_task->context.registers[1];
+  for (size_t i = 0; i < MAX_SRR_PAIRS && n < max_histograms; ++i) {
+    if (srr_histograms[i].sender) {
+      histograms[n++] = srr_histograms[i];
+    }
+  }
+#endif
+  curr_task->context.registers[0] = n;
+  ready_push(curr_task);
+}
+
+void task_manager::k_set_affinity(task_descriptor *curr_task) {
+  tid_t tid = curr_task->context.registers[0];
+  // cores that do not exist are dropped
+  auto affinity = static_cast<affinity_t>(curr_task->context.registers[1]) & ALL_CORES;
+  task_descriptor *task = task_of(tid);
+  if (!task) {
+    curr_task->context.registers[0] = -1;
+  } else if (!affinity) {
+    curr_task->context.registers[0] = -2;
+  } else {
+    task->affinity = affinity;
+    if (task->state == task_state_t::Ready && !(affinity & (1u << task->core))) {
+      // move it to a queue it may be run from
+      ready[task->core].remove(*task, task->priority);
+      ready_push(task);
+    }
+    // anything else moves the next time it becomes ready
+    curr_task->context.registers[0] = 0;
+  }
+  ready_push(curr_task);
+}
+
+void task_manager::k_lookup_name(task_descriptor *curr_task) {
+  auto key = static_cast<name_key_t>(curr_task->context.registers[0]);
+  auto &entry = name_cache[key & (NAME_CACHE_SIZE - 1)];
+  bool hit = key && entry.key == key && task_of(entry.tid);
+  curr_task->context.registers[0] = hit ? entry.tid : 0;
+  ready_push(curr_task);
+}
+
+void task_manager::k_publish_name(task_descriptor *curr_task) {
+  auto key = static_cast<name_key_t>(curr_task->context.registers[0]);
+  tid_t tid = curr_task->context.registers[1];
+  if (!key || !task_of(tid)) {
+    curr_task->context.registers[0] = -1;
+  } else {
+    name_cache[key & (NAME_CACHE_SIZE - 1)] = {key, tid};
+    curr_task->context.registers[0] = 0;
+  }
+  ready_push(curr_task);
+}
+
+void task_manager::k_register_channel(task_descriptor *curr_task) {
+  curr_task->context.registers[0] = num_channels < MAX_NUM_CHANNELS ? num_channels++ : -1;
+  ready_push(curr_task);
+}
+
+void task_manager::k_await_channel(task_descriptor *curr_task) {
+  size_t channel = curr_task->context.registers[0];
+  if (channel >= num_channels) {
+    curr_task->context.registers[0] = -1;
+  } else if (channels[channel].waiter) {
+    curr_task->context.registers[0] = -2;
+  } else if (!channels[channel].signalled) {
+    set_state(curr_task, task_state_t::EventWait);
+    channels[channel].waiter = curr_task;
+    return;
+  } else {
+    channels[channel].signalled = false;
+    curr_task->context.registers[0] = 0;
+  }
+  ready_push(curr_task);
+}
+
+void task_manager::k_signal_channel(task_descriptor *curr_task) {
+  size_t channel = curr_task->context.registers[0];
+  if (channel >= num_channels) {
+    curr_task->context.registers[0] = -1;
+  } else {
+    auto &state = channels[channel];
+    if (state.waiter) {
+      state.waiter->context.registers[0] = 0;
+      trace(trace_kind_t::SIGNAL, state.waiter->tid, channel);
+      ready_push(state.waiter);
+      state.waiter = nullptr;
+    } else {
+      state.signalled = true;
+    }
+    curr_task->context.registers[0] = 0;
+  }
+  ready_push(curr_task);
+}
+
+void task_manager::k_set_periodic(task_descriptor *curr_task) {
+  uint32_t period = static_cast<uint32_t>(curr_task->context.registers[0]) * NUM_TICKS_IN_1US;
+  uint32_t deadline = static_cast<uint32_t>(curr_task->context.registers[1]) * NUM_TICKS_IN_1US;
+  if (!deadline) {
+    deadline = period;
+  }
+  if (deadline > period) {
+    curr_task->context.registers[0] = -1;
+  } else {
+    // what the task runs now is its first release
+    curr_task->period = period;
+    curr_task->relative_deadline = deadline;
+    curr_task->release = now;
+    curr_task->deadline = now + deadline;
+    curr_task->context.registers[0] = 0;
+  }
+  ready_push(curr_task);
+}
+
+void task_manager::k_wait_next_period(task_descriptor *curr_task) {
+  if (!curr_task->period) {
+    curr_task->context.registers[0] = -1;
+    ready_push(curr_task);
+    return;
+  }
+  auto &profile = curr_task->profile;
+  if (!release_queue::before(now, curr_task->deadline)) {
+    ++profile.deadline_misses;
+  }
+  uint32_t period = curr_task->period;
+  uint32_t release = curr_task->release + period;
+  // releases whose deadline passed already are skipped, keeping the phase of the rest
+  int32_t late = now - (release + curr_task->relative_deadline);
+  uint32_t skipped = 0;
+  if (late >= 0) {
+    skipped = static_cast<uint32_t>(late) / period + 1;
+    release += skipped * period;
+    profile.skipped_releases += skipped;
+  }
+  curr_task->release = release;
+  curr_task->deadline = release + curr_task->relative_deadline;
+  curr_task->context.registers[0] = skipped;
+  if (release_queue::before(now, release)) {
+    set_state(curr_task, task_state_t::EventWait);
+    releases.push(release, curr_task);
+  } else {
+    ready_push(curr_task);
+  }
+}
+
+void task_manager::release_periodic_tasks(uint32_t now) {
+  while (releases.expired(now)) {
+    auto *task = releases.top().value;
+    releases.pop();
+    trace(trace_kind_t::RELEASE, task->tid);
+    ready_push(task);
+  }
+}
+
+bool task_manager::next_release(uint32_t &release) const {
+  if (releases.empty()) {
+    return false;
+  }
+  release = releases.top().deadline;
+  return true;
+}
+
+void task_manager::k_trace_dump(task_descriptor *curr_task) {
+  size_t n = 0;
+#if TRACING
+  auto *records = reinterpret_cast<trace_record_t *>(curr_task->context.registers[0]);
+  size_t max_records = curr_task->context.registers[1];
+  n = traces.drain(records, max_records);
+#endif
+  curr_task->context.registers[0] = n;
+  ready_push(curr_task);
+}
+
+void task_manager::k_fp_trap(task_descriptor *curr_task) {
+  auto *&owner = fp_owner[curr_task->core];
+  // the kernel never uses fp/simd, so the registers still hold the state of the last owner
+  if (owner) {
+    save_fp_context(&owner->context.fp);
+  }
+  if (curr_task->fp_used) {
+    load_fp_context(&curr_task->context.fp);
+  } else {
+    reset_fp_context();
+    curr_task->fp_used = true;
+  }
+  owner = curr_task;
+  // the trapped instruction runs again
+  ready_push(curr_task);
+}
+
+void task_manager::prepare_fp(task_descriptor *task) {
+  bool owns = fp_owner[task->core] == task;
+  // most switches are between tasks that do not own the registers, and do not touch cpacr
+  if (owns != fp_enabled[task->core]) {
+    set_fp_trap(!owns);
+    fp_enabled[task->core] = owns;
+  }
+}
+
+void task_manager::flush_fp(task_descriptor *task) {
+  if (fp_owner[task->core] == task) {
+    save_fp_context(&task->context.fp);
+    fp_owner[task->core] = nullptr;
+  }
+}
+
+void task_manager::k_stack_usage(task_descriptor *curr_task) {
+  tid_t tid = curr_task->context.registers[0];
+  auto *usage = reinterpret_cast<stack_usage_t *>(curr_task->context.registers[1]);
+  task_descriptor *task = task_of(tid);
+  if (!task) {
+    curr_task->context.registers[0] = -1;
+    ready_push(curr_task);
+    return;
+  }
+  usage->stack_class = task->stack_class;
+  usage->size = STACK_CLASS_SIZES[task->stack_class];
+  usage->high_water = stack_high_water(task);
   curr_task->context.registers[0] = 0;
   ready_push(curr_task);
 }
 
 void task_manager::kp_dcache(task_descriptor *curr_task) {
+#if SMP
+  // the other cores keep caching the memory of the kernel
+  curr_task->context.registers[0] = -1;
+#else
   kernel::enable_dcache();
+  curr_task->context.registers[0] = 0;
+#endif
   ready_push(curr_task);
 }
 
 void task_manager::kp_bcache(task_descriptor *curr_task) {
+#if SMP
+  // the other cores keep caching the memory of the kernel
+  curr_task->context.registers[0] = -1;
+#else
   kernel::enable_bcache();
+  curr_task->context.registers[0] = 0;
+#endif
   ready_push(curr_task);
 }
 
 void task_manager::kp_icache(task_descriptor *curr_task) {
+#if SMP
+  // the other cores keep caching the memory of the kernel
+  curr_task->context.registers[0] = -1;
+#else
   kernel::enable_icache();
+  curr_task->context.registers[0] = 0;
+#endif
+  ready_push(curr_task);
+}
+
+void task_manager::kp_mmu(task_descriptor *curr_task) {
+#if SMP
+  // the other cores keep caching the memory of the kernel
+  curr_task->context.registers[0] = -1;
+#else
+  kernel::enable_mmu();
+  curr_task->context.registers[0] = 0;
+#endif
+  ready_push(curr_task);
+}
+
+void task_manager::kp_full_frames(task_descriptor *curr_task) {
+  // only this core
+  set_full_frames(curr_task->context.registers[0]);
   ready_push(curr_task);
 }
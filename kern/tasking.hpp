@@ -3,54 +3,131 @@
 #include "../generic/containers.hpp"
 #include "kstddefs.hpp"
 #include "gpio.hpp"
+#include "trace.hpp"
+#include "srr_histogram.hpp"
+
+static constexpr size_t NUM_STACKS = STACK_CLASS_COUNTS[STACK_SMALL] + STACK_CLASS_COUNTS[STACK_MEDIUM] + STACK_CLASS_COUNTS[STACK_LARGE];
+static constexpr size_t TOTAL_STACK_SIZE =
+  STACK_CLASS_SIZES[STACK_SMALL] * STACK_CLASS_COUNTS[STACK_SMALL] +
+  STACK_CLASS_SIZES[STACK_MEDIUM] * STACK_CLASS_COUNTS[STACK_MEDIUM] +
+  STACK_CLASS_SIZES[STACK_LARGE] * STACK_CLASS_COUNTS[STACK_LARGE];
 
 namespace kernel {
-  enum class task_state_t : int {
-    Free,    // in free list
-    Active,  // currently running
-    Ready,   // can be run
-    Blocked, // waiting on something
-    SendWait,    // sender waiting on receiver
-    ReceiveWait, // receiver waiting on sender
-    ReplyWait,   // sender waiting on reply
-    EventWait,   // waiting on some event
+  // Align everything to 64bit for easier time on the assembler side
+  // fp/simd registers, switched lazily by the kernel instead of on every context switch
+  struct fp_context_t {
+    uint64_t q[64];  // q0 to q31
+    uint64_t fpcr;
+    uint64_t fpsr;
   };
 
-  // Align everything to 64bit for easier time on the assembler side
   struct context_t {
     int64_t registers[31];  // x0 to x30
     uint64_t spsr;  // saved program status reg
     uint64_t stack_pointer;
     uint64_t exception_lr;
+    // whether every register was saved, or only those a syscall does not clobber
+    uint64_t full_frame;
+    uint64_t stack_limit;  // lowest address of the stack. not touched by the context switch
+    alignas(16) fp_context_t fp;  // only valid once the task has used fp/simd and lost the registers
   };
+  // context_switch.S
+  static_assert(offsetof(context_t, spsr) == 248);
+  static_assert(offsetof(context_t, exception_lr) == 264);
+  static_assert(offsetof(context_t, full_frame) == 272);
 
   struct task_descriptor : public troll::forward_link {
     tid_t tid = 0;
     tid_t parent_tid = 0;
+    // the priority the task is scheduled at. without inheritance it is always base_priority
     priority_t priority = PRIORITY_UNDEFINED;
+    // the priority the task was created with
+    priority_t base_priority = PRIORITY_UNDEFINED;
     task_state_t state = task_state_t::Free;
+    // cores the task may run on, and the one whose ready queue it goes to
+    affinity_t affinity = ALL_CORES;
+    uint8_t core = 0;
+    stack_class_t stack_class = STACK_LARGE;
+    // index of the stack in the pool of its class
+    uint16_t stack_slot = 0;
+    // set while the task is blocked in SendShort: the message sits in x1..x3
+    // and the reply buffer in x4 and x5 instead of x3 and x4
+    bool message_in_registers = false;
+    // whether context.fp was ever filled in, or the task has to start with clean fp/simd state
+    bool fp_used = false;
+    // lowest stack pointer the task had at a kernel entry
+    uint64_t lowest_sp = 0;
+    // tid and priority of the profile are only filled in when it is copied out
+    task_profile_t profile {};
+    // when the task entered its current state
+    uint32_t state_since = 0;
+    // periodic tasks: the time between releases, and how long after its release each has
+    // to finish, in system timer ticks. the task is aperiodic while period is 0
+    uint32_t period = 0;
+    uint32_t relative_deadline = 0;
+    // the current or next release, and the deadline of that release
+    uint32_t release = 0;
+    uint32_t deadline = 0;
+#if BENCHMARKING
+    // when the task last called Send()
+    uint32_t send_time = 0;
+#endif
+#if PRIORITY_INHERITANCE
+    // the task this one is in SendWait or ReplyWait on, or 0
+    tid_t blocked_on = 0;
+    // number of tasks blocked on this one, by their (effective) priority
+    uint16_t waiters[NUM_PRIORITIES] {};
+#endif
     volatile context_t context;  // TODO: initialize the context to point to some error function
 
     task_descriptor() = default;
   };
 
+  // a uart register access of a task, waiting for or using the spi bus
+  struct spi_request {
+    task_descriptor *task;
+    // prepare buffer of the access. single register accesses use short_buffer
+    char *buffer;
+    char short_buffer[2];
+    uint32_t sendlen;
+    uint32_t recvlen;
+  };
+
   struct task_reuse_status {
-    size_t parent_gen = 0;
-    size_t gen = 0;
-    bool free = 1;
+    // tid of the task that has the descriptor, or 0 while it is free
+    tid_t tid = 0;
+    // number of tasks that had the descriptor
+    uint32_t gen = 0;
   };
 
   class task_manager {
   public:
-    task_manager() = default;
+    task_manager();
     task_manager(task_manager &) = delete;
 
     // allocate a task. its tid is created automatically, but do not run it.
-    task_descriptor *new_task(tid_t parent_tid, size_t parent_generation, priority_t priority, task_state_t state = task_state_t::Ready);
-    // get a runnable stack, or nullptr
-    task_descriptor *get_task();
+    // there must be a free stack of stack_class
+    task_descriptor *new_task(tid_t parent_tid, priority_t priority,
+                              stack_class_t stack_class = STACK_LARGE, task_state_t state = task_state_t::Ready);
+    // get a runnable task for core, or nullptr
+    task_descriptor *get_task(size_t core = 0);
     void ready_push(task_descriptor *task);
 
+    // profiling: the kernel's notion of the current time, used to timestamp state changes
+    void set_time(uint32_t now);
+    // profiling: account an activation of task that ran for run_ticks and came back with request
+    void record_activation(task_descriptor *task, uint32_t run_ticks, uint32_t request);
+    // adds a record to the kernel trace. does nothing unless TRACING
+    void trace(trace_kind_t kind, tid_t tid, uint16_t arg = 0) {
+#if TRACING
+      traces.record(kind, tid, arg);
+#else
+      (void)kind;
+      (void)tid;
+      (void)arg;
+#endif
+    }
+
     // kernel syscalls
     void k_create(task_descriptor *curr_task);
     void k_my_tid(task_descriptor *curr_task);
@@ -59,33 +136,158 @@ namespace kernel {
     void k_send(task_descriptor *curr_task);
     void k_receive(task_descriptor *curr_task);
     void k_reply(task_descriptor *curr_task);
+    void k_send_short(task_descriptor *curr_task);
+    void k_reply_short(task_descriptor *curr_task);
+    void k_reply_receive(task_descriptor *curr_task);
     void k_await_event(task_descriptor *curr_task, gpio::uart_interrupt_state& state);
+    void k_await_event_buffer(task_descriptor *curr_task, gpio::uart_interrupt_state& state);
     void k_exit(task_descriptor *curr_task);
     void k_uart_write(task_descriptor *curr_task);
     void k_uart_write_n(task_descriptor *curr_task);
     void k_uart_read(task_descriptor *curr_task);
+    void k_uart_read_n(task_descriptor *curr_task);
+    void k_task_profile(task_descriptor *curr_task);
+    void k_srr_histogram(task_descriptor *curr_task);
+    void k_stack_usage(task_descriptor *curr_task);
+    void k_set_affinity(task_descriptor *curr_task);
+    void k_lookup_name(task_descriptor *curr_task);
+    void k_publish_name(task_descriptor *curr_task);
+    void k_register_channel(task_descriptor *curr_task);
+    void k_await_channel(task_descriptor *curr_task);
+    void k_signal_channel(task_descriptor *curr_task);
+    void k_set_periodic(task_descriptor *curr_task);
+    void k_wait_next_period(task_descriptor *curr_task);
+    void k_trace_dump(task_descriptor *curr_task);
+    // the task used fp/simd registers that hold the state of another task
+    void k_fp_trap(task_descriptor *curr_task);
+    // lets task use the fp/simd registers without trapping if it owns them. call before running it
+    void prepare_fp(task_descriptor *task);
 
     void wake_up_tasks_on_event(events_t event_id, int return_value);
+    // makes the periodic tasks whose release is at or before now ready
+    void release_periodic_tasks(uint32_t now);
+    // the earliest release a periodic task waits for. false if none does
+    bool next_release(uint32_t &release) const;
+    // moves what the rx fifo of uart_channel holds into the kernel buffer, and hands it to the
+    // tasks awaiting it. rx interrupts stay off while the buffer is full
+    void drain_uart_rx(size_t uart_channel, gpio::uart_interrupt_state& state);
+    // on the spi interrupt: finishes the access in flight, if it is done, and starts the next
+    void continue_spi();
 
     // configure hardware cache (performance syscalls)
     void kp_dcache(task_descriptor *curr_task);
     void kp_bcache(task_descriptor *curr_task);
     void kp_icache(task_descriptor *curr_task);
+    void kp_mmu(task_descriptor *curr_task);
+    void kp_full_frames(task_descriptor *curr_task);
 
   private:
-    // reserved memory for stacks
-    alignas(SP_ALIGNMENT) char stack_buff[TASK_STACK_SIZE * MAX_NUM_TASKS];
+    using release_queue = troll::deadline_queue<task_descriptor *, MAX_NUM_TASKS>;
+
+    void set_state(task_descriptor *task, task_state_t state);
+    // puts task in the ready queue of priority on core. periodic tasks go in front of
+    // the aperiodic ones, by earliest deadline
+    void queue_ready(task_descriptor *task, size_t core, priority_t priority);
+    // the task of tid, or nullptr if it exited or never existed
+    task_descriptor *task_of(tid_t tid);
+    void send(task_descriptor *curr_task);
+    // completes an await of received bytes of uart_channel. there must be some
+    void deliver_uart_rx(task_descriptor *task, size_t uart_channel);
+    // blocks the task of request until the spi engine did the access
+    void submit_spi(const spi_request &request);
+    // starts queued accesses until one has to wait for the spi interrupt
+    void start_spi();
+    // unblocks the task of the access in front
+    void complete_spi();
+    bool has_free_stack(stack_class_t stack_class) const;
+    // takes a painted stack from the pool of the task's class
+    void allocate_stack(task_descriptor *task);
+    void free_stack(task_descriptor *task);
+    char *stack_bottom(stack_class_t stack_class, size_t slot);
+    // bytes below the top of the stack that are not paint anymore. words left below a
+    // run of STACK_PAINT_RUN paint words are not found
+    size_t stack_high_water(task_descriptor *task);
+    // saves the fp/simd registers of task if its core holds them. must run on that core
+    void flush_fp(task_descriptor *task);
+    // unblocks the sender, but leaves the replier for the caller to schedule
+    void reply(task_descriptor *curr_task, bool short_reply);
+#if BENCHMARKING
+    void record_srr_latency(task_descriptor *sender, tid_t receiver);
+#endif
+#if PRIORITY_INHERITANCE
+    // blocks waiter on target, or releases it, and lends or takes back its priority
+    void add_waiter(task_descriptor *waiter, task_descriptor *target);
+    void remove_waiter(task_descriptor *waiter);
+    // recomputes the priority of task from its waiters and passes any change down
+    // the chain of tasks it is blocked on
+    void update_priority(task_descriptor *task);
+#endif
+
+    // reserved memory for stacks: the pools of all classes, smallest first
+    alignas(SP_ALIGNMENT) char stack_buff[TOTAL_STACK_SIZE];
+    // stacks of each class that were freed, most recently freed last. they are
+    // reused before the ones that were never handed out
+    uint16_t free_stacks[NUM_STACK_CLASSES][NUM_STACKS];
+    size_t num_free_stacks[NUM_STACK_CLASSES] {};
+    // stacks of each class that were handed out at least once
+    size_t num_used_stacks[NUM_STACK_CLASSES] {};
+    // high water mark of the last task on each freed stack, which is all that
+    // has to be painted again
+    uint32_t stack_dirty_bytes[NUM_STACK_CLASSES][NUM_STACKS];
     // free list of task descriptors
     troll::free_list<task_descriptor, MAX_NUM_TASKS> allocator;
-    // ready tasks
-    troll::intrusive_priority_scheduling_queue<task_descriptor, NUM_PRIORITIES> ready;
+    // ready tasks of each core
+    troll::intrusive_priority_scheduling_queue<task_descriptor, NUM_PRIORITIES> ready[NUM_CORES];
+#if SMP
+    // cores that found nothing to run and sleep until woken
+    affinity_t idle_cores = 0;
+#endif
+    // the task whose fp/simd state is in the registers of each core, or nullptr
+    task_descriptor *fp_owner[NUM_CORES] {};
+    // whether the task running on each core may use the fp/simd registers
+    bool fp_enabled[NUM_CORES] {};
     // this keeps track of the reuse stats of each task descriptor
-    // useful for determining whether a parent task has already exited
+    // useful for telling a stale tid from the one of the current task
     task_reuse_status task_reuse_statuses[MAX_NUM_TASKS];
     // mailboxes for message passing
     troll::queue<task_descriptor> mailboxes[MAX_NUM_TASKS];
     // event queues
     troll::queue<task_descriptor> event_queues[MAX_NUM_EVENTS];
+    // received bytes of each uart channel, drained from the fifo by the interrupt handler
+    troll::ring_buffer<char, UART_RX_BUFFER_SIZE> uart_rx_buffers[2];
+    // register accesses of tasks, in order. the front one is on the bus. a task has at most one
+    troll::ring_buffer<spi_request, MAX_NUM_TASKS> spi_requests;
+    // tids of registered names, in the slot picked by the low bits of their key. a tid
+    // carries the generation of its descriptor, so the entry of a task that exited is
+    // stale as soon as task_of() fails. a collision only evicts; the nameserver has all
+    struct name_cache_entry {
+      name_key_t key;
+      tid_t tid;
+    };
+    name_cache_entry name_cache[NAME_CACHE_SIZE] {};
+    // the event of each shared memory channel. a signal nobody waited for is kept
+    // for the next wait, so the consumer cannot miss it
+    struct channel_state {
+      task_descriptor *waiter;
+      bool signalled;
+    };
+    channel_state channels[MAX_NUM_CHANNELS] {};
+    size_t num_channels = 0;
+    // periodic tasks waiting in WaitNextPeriod, by their next release
+    release_queue releases;
     // char missed_event_queues[MAX_NUM_EVENTS] = {0};
+    // tickless mode: an alarm fires only once, so one that came while nobody was
+    // waiting on the timer is handed to the next waiter
+    bool missed_alarm = false;
+    // see set_time()
+    uint32_t now = 0;
+#if TRACING
+    trace_buffer traces;
+#endif
+#if BENCHMARKING
+    // open addressing table of (sender, receiver) pairs. a sender of 0 marks an empty
+    // entry, and transactions of pairs that do not fit are not recorded
+    srr_histogram_t srr_histograms[MAX_SRR_PAIRS] {};
+#endif
   };
 }  // namespace kernel
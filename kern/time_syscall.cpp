@@ -41,3 +41,42 @@ int DelayUntil(int tid, int ticks) {
   }
   return reply.data;
 }
+
+int64_t TimeUs(int tid) {
+  utils::enumed_class<CLOCK_REPLY, uint32_t> reply;
+  int replylen = SendValue(tid, CLOCK_MESSAGE::TIME_US, reply);
+  if (replylen < 1 || reply.header != CLOCK_REPLY::TIME_OK) {
+    return -1;
+  }
+  return reply.data;
+}
+
+int64_t DelayUs(int tid, int us) {
+  if (us < 0) {
+    return -2;
+  }
+  utils::enumed_class<CLOCK_REPLY, uint32_t> reply;
+  int replylen = SendValue(tid, utils::enumed_class {
+    CLOCK_MESSAGE::DELAY_US,
+    static_cast<uint32_t>(us),
+  }, reply);
+  if (replylen < 1 || reply.header != CLOCK_REPLY::DELAY_OK) {
+    return -1;
+  }
+  return reply.data;
+}
+
+int64_t DelayUntilUs(int tid, uint32_t us) {
+  utils::enumed_class<CLOCK_REPLY, uint32_t> reply;
+  int replylen = SendValue(tid, utils::enumed_class {
+    CLOCK_MESSAGE::DELAY_UNTIL_US,
+    us,
+  }, reply);
+  if (replylen > 0 && reply.header == CLOCK_REPLY::DELAY_NEGATIVE) {
+    return -2; // negative delay
+  }
+  if (replylen < 1 || reply.header != CLOCK_REPLY::DELAY_OK) {
+    return -1;
+  }
+  return reply.data;
+}
@@ -1,8 +1,14 @@
 #include "timer.hpp"
+#if HOST_BUILD
+#include "../host/host.hpp"
+#endif
 
 // see broadcom document chapter 10
 
 namespace {
+#if HOST_BUILD
+static host::system_timer_t* const system_timer = &host::system_timer;
+#else
 struct SYSTEM_TIMER {
   uint32_t CS;
   uint32_t CLO;
@@ -14,6 +20,11 @@ struct SYSTEM_TIMER {
 };
 
 static volatile SYSTEM_TIMER* const system_timer = (SYSTEM_TIMER*)(0xfe003000);
+#endif
+
+// the compare register only matches on equality, so an alarm must be far enough
+// in the future to not be passed before it is written
+static constexpr uint32_t MIN_ALARM_LEAD = 20 * NUM_TICKS_IN_1US;
 };
 
 namespace kernel {
@@ -26,6 +37,9 @@ namespace kernel {
  *   interrupt_when(next_tick);
  *   next_tick += interval;
  * }
+ *
+ * in tickless mode there is no loop; the timer only interrupts at alarms set
+ * through set_alarm().
 */
 
 uint32_t timer::read_current_tick() {
@@ -33,14 +47,33 @@ uint32_t timer::read_current_tick() {
 }
 
 void timer::initialize() {
+#if !TICKLESS
   next_tick = read_current_tick() + tick_interval;
   set_timer_interrupt(next_tick);
+#endif
 }
 
 void timer::rearm_timer_interrupt() {
   system_timer->CS = (1 << 1); // clears the interrupt for C1
+#if TICKLESS
+  alarm_pending = false;
+#else
   next_tick += tick_interval;
   set_timer_interrupt(next_tick);
+#endif
+}
+
+void timer::set_alarm(uint32_t target_tick) {
+  if (alarm_pending && static_cast<int32_t>(target_tick - next_tick) >= 0) {
+    return;  // the pending alarm fires first anyway
+  }
+  uint32_t earliest = read_current_tick() + MIN_ALARM_LEAD;
+  if (static_cast<int32_t>(target_tick - earliest) < 0) {
+    target_tick = earliest;
+  }
+  next_tick = target_tick;
+  alarm_pending = true;
+  set_timer_interrupt(next_tick);
 }
 
 void timer::set_timer_interrupt(uint32_t target_tick) {
@@ -9,11 +9,15 @@ public:
   timer() : next_tick{0} {}
   void initialize();
   void rearm_timer_interrupt();
+  // tickless mode: interrupt at target_tick, unless an earlier alarm is pending
+  void set_alarm(uint32_t target_tick);
 
   static uint32_t read_current_tick();
 private:
   uint32_t next_tick;
   const uint32_t tick_interval = TIMER_INTERRUPT_INTERVAL;
+  // tickless mode: whether next_tick holds an alarm that has not fired yet
+  bool alarm_pending = false;
 
   void set_timer_interrupt(uint32_t target_tick);
 };
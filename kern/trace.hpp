@@ -0,0 +1,47 @@
+#pragma once
+
+#include "kstddefs.hpp"
+#include "smp.hpp"
+
+namespace kernel {
+
+/**
+ * the last TRACE_BUFFER_SIZE records of the kernel trace. once full, every record
+ * overwrites the oldest one. only touched with the kernel lock held.
+*/
+class trace_buffer {
+public:
+  void record(trace_kind_t kind, tid_t tid, uint16_t arg) {
+    auto &r = records[(head + size) % TRACE_BUFFER_SIZE];
+    r.time = GET_TIMER_COUNT();
+    r.tid = tid;
+    r.kind = kind;
+    r.core = core_id();
+    r.arg = arg;
+    if (size < TRACE_BUFFER_SIZE) {
+      ++size;
+    } else {
+      head = (head + 1) % TRACE_BUFFER_SIZE;
+    }
+  }
+
+  /**
+   * moves up to max of the oldest records to out. returns how many.
+  */
+  size_t drain(trace_record_t *out, size_t max) {
+    size_t n = 0;
+    for (; n < max && size; ++n, --size) {
+      out[n] = records[head];
+      head = (head + 1) % TRACE_BUFFER_SIZE;
+    }
+    return n;
+  }
+
+private:
+  trace_record_t records[TRACE_BUFFER_SIZE];
+  // the oldest record
+  size_t head = 0;
+  size_t size = 0;
+};
+
+}  // namespace kernel
@@ -1,36 +1,110 @@
 #pragma once
 #include "kstddefs.hpp"
 
-extern "C" int Create(priority_t priority, void (*function)());
+struct srr_histogram_t;
+
+// the stack comes from the pool of stack_class. returns -2 if there are no free
+// task descriptors or no free stacks of that class left
+extern "C" int Create(priority_t priority, void (*function)(), stack_class_t stack_class = STACK_LARGE);
 extern "C" int MyTid();
 extern "C" int MyParentTid();
 extern "C" void Yield();
 extern "C" void Exit();
+// on UART_R0 and UART_R1, returns the number of bytes the kernel holds for the channel
 extern "C" int AwaitEvent(int eventid);
+// blocks until the kernel holds received bytes of the channel of UART_R0 or UART_R1, and
+// takes up to buflen of them. returns the number of bytes taken, or -1 if eventid is not
+// a receive event or buflen is negative
+extern "C" int AwaitEventBuffer(int eventid, char* buffer, int buflen);
 extern "C" void Terminate();
 
 // message passing
 extern "C" int Send(int tid, const char* msg, int msglen, char* reply, int rplen);
 extern "C" int Receive(int* tid, char* msg, int msglen);
 extern "C" int Reply(int tid, const char* reply, int rplen);
+// same as Send/Reply, but the payload of at most MAX_SHORT_MESSAGE_SIZE bytes
+// is passed in w0 and w1 (little endian) instead of through memory
+extern "C" int SendShort(int tid, uint64_t w0, uint64_t w1, int msglen, char* reply, int rplen);
+extern "C" int ReplyShort(int tid, uint64_t w0, uint64_t w1, int rplen);
+// Reply() followed by Receive() in one kernel entry, for server loops.
+// reply_tid 0 skips the reply; a failed reply is not reported
+extern "C" int ReplyReceive(int reply_tid, const char* reply, int rplen, int* tid, char* msg, int msglen);
 
 // wrapper system calls
-// names must be null-terminated
+// names must be null-terminated. RegisterAs returns -2 if another name with the same
+// key is registered already
 int RegisterAs(const char* name);
 int WhoIs(const char* name);
+// WhoIs of the name whose name_key() is key. does not need the nameserver once the
+// kernel has the name cached
+int WhoIsKey(name_key_t key);
+
+// the name cache of the kernel, which the nameserver fills in on registration.
+// LookupName returns the tid registered with key, or 0 if the name is not cached
+// or its task exited. only the nameserver should call PublishName
+extern "C" int LookupName(name_key_t key);
+extern "C" int PublishName(name_key_t key, int tid);
 
 // wrapper system calls for clock
 int Time(int tid);
 int Delay(int tid, int ticks);
 int DelayUntil(int tid, int ticks);
+// microsecond variants. times are the low 32 bits of the system timer, so they
+// wrap around every ~71 minutes; negative return values are errors as above
+int64_t TimeUs(int tid);
+int64_t DelayUs(int tid, int us);
+int64_t DelayUntilUs(int tid, uint32_t us);
+
+// tickless mode only: have the next timer event at system timer value target,
+// unless an earlier one is already pending. returns -1 in periodic mode.
+// only the clock server should call this
+extern "C" int SetAlarm(uint32_t target);
 
-// benchmarking
-extern "C" void DCache();
-extern "C" void ICache();
-extern "C" void BCache();
+// benchmarking. these change the caches of the calling core only, and return -1 in SMP
+// builds, where the other cores would no longer be coherent with it
+extern "C" int DCache();
+extern "C" int ICache();
+extern "C" int BCache();
+// turns on the mmu along with both caches
+extern "C" int MMUCache();
+// whether syscalls of this core save every register like interrupts do, instead of only
+// those that survive a function call
+extern "C" void FullFrames(bool full);
 
 // things to do while idling
 extern "C" void TimeDistribution(time_distribution_t* time_distribution);
+// copies the counters of up to max_profiles live tasks, returns how many were copied
+extern "C" int TaskProfile(task_profile_t* profiles, size_t max_profiles);
+// copies up to max_histograms send-reply latency histograms, returns how many were copied.
+// always 0 unless built with BENCHMARKING
+extern "C" int SrrHistogram(srr_histogram_t* histograms, size_t max_histograms);
+// moves up to max_records of the oldest records of the kernel trace to records, returns
+// how many were moved. always 0 unless built with TRACING
+extern "C" int TraceDump(trace_record_t* records, size_t max_records);
+// fills in the stack class, size and high water mark of tid. returns -1 if tid is not alive
+extern "C" int StackUsage(int tid, stack_usage_t* usage);
+// restricts tid to the cores in the mask. children inherit the cores of their parent.
+// returns -1 if tid is not alive, -2 if the mask holds no core of this build
+extern "C" int SetAffinity(int tid, affinity_t cores);
+
+// events of shared memory channels (see troll::spsc_ring). RegisterChannel returns a new
+// channel, or -1 if there are no more. AwaitChannel blocks the consumer until the channel
+// is signalled, and returns at once if it was signalled while nobody waited. it returns -1
+// for an invalid channel, -2 if another task waits on it. SignalChannel wakes the consumer
+// and never blocks; it returns -1 for an invalid channel
+extern "C" int RegisterChannel();
+extern "C" int AwaitChannel(int channel);
+extern "C" int SignalChannel(int channel);
+
+// periodic tasks are released by the kernel every period microseconds, starting from the
+// call to SetPeriodic, and each release has to finish within deadline microseconds (0 is
+// the period). among ready tasks of the same priority, the earliest deadline runs first.
+// SetPeriodic returns -1 if the deadline is longer than the period; a period of 0 makes
+// the task aperiodic again. WaitNextPeriod ends the current release and blocks until the
+// next one. it returns the number of releases that were skipped because the task ran
+// past them, or -1 if the task is not periodic. misses are counted in task_profile_t
+extern "C" int SetPeriodic(uint32_t period, uint32_t deadline);
+extern "C" int WaitNextPeriod();
 
 // put cpu into low power
 extern "C" void SaveThePlanet();
@@ -40,6 +114,8 @@ extern "C" int UartWriteRegister(int channel, char reg, char data);
 // "data" must start from index 1, and index 0 is used for something else internally
 extern "C" int UartWriteRegisterN(int channel, char reg, const char* data, size_t len);
 extern "C" int UartReadRegister(int channel, char reg);
+// reads reg len times in one spi transaction into data[1] to data[len]. data[0] is scratch
+extern "C" int UartReadRegisterN(int channel, char reg, char* data, size_t len);
 int Getc(int tid, int channel);
 int Putc(int tid, int channel, char c);
 int Puts(int tid, int channel, const char* s, size_t len);
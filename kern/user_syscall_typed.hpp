@@ -1,14 +1,17 @@
 #pragma once
 
+#include <type_traits>
 #include "user_syscall.h"
 
 // syscall wrapper functions and templates
 
 inline auto TaskFinder(const char* name) {
-  auto tid = WhoIs(name);
-  return [name, tid] () mutable -> tid_t {
+  // hashed once here, and at compile time if name is a literal
+  auto key = name_key(name);
+  auto tid = WhoIsKey(key);
+  return [key, tid] () mutable -> tid_t {
     if (tid < 1) {
-      tid = WhoIs(name);
+      tid = WhoIsKey(key);
     }
     return tid;
   };
@@ -17,12 +20,32 @@ inline auto TaskFinder(const char* name) {
 struct null_reply_t {};
 static constexpr null_reply_t null_reply;
 
+// whether a whole T fits in the two registers of SendShort/ReplyShort
+template<class T>
+static constexpr bool is_short_message_v = std::is_trivially_copyable_v<T> && sizeof(T) <= MAX_SHORT_MESSAGE_SIZE;
+
+struct short_message_t {
+  uint64_t words[2] = {0, 0};
+};
+
+template<class T>
+inline short_message_t to_short_message(const T& msg) {
+  short_message_t packed;
+  __builtin_memcpy(packed.words, &msg, sizeof(T));
+  return packed;
+}
+
 // send from value reference, receive nothing
-// automatically fills in msglen
+// automatically fills in msglen; small messages are passed in registers
 template<class T>
 inline int SendValue(tid_t tid, const T& msg, null_reply_t) {
-  auto msglen = sizeof(T); 
-  return Send(tid, reinterpret_cast<const char*>(&msg), msglen, nullptr, 0);
+  auto msglen = sizeof(T);
+  if constexpr (is_short_message_v<T>) {
+    auto packed = to_short_message(msg);
+    return SendShort(tid, packed.words[0], packed.words[1], msglen, nullptr, 0);
+  } else {
+    return Send(tid, reinterpret_cast<const char*>(&msg), msglen, nullptr, 0);
+  }
 }
 
 // send from value reference, receive nothing
@@ -33,12 +56,17 @@ inline int SendValue(tid_t tid, const T& msg, size_t msglen, null_reply_t) {
 }
 
 // send from value reference, receive into value reference
-// automatically fills in msglen and rplen
+// automatically fills in msglen and rplen; small messages are passed in registers
 template<class T, class U>
 inline int SendValue(tid_t tid, const T& msg, U& reply) {
   auto msglen = sizeof(T);
   auto rplen = sizeof(U);
-  return Send(tid, reinterpret_cast<const char*>(&msg), msglen, reinterpret_cast<char*>(&reply), rplen);
+  if constexpr (is_short_message_v<T>) {
+    auto packed = to_short_message(msg);
+    return SendShort(tid, packed.words[0], packed.words[1], msglen, reinterpret_cast<char*>(&reply), rplen);
+  } else {
+    return Send(tid, reinterpret_cast<const char*>(&msg), msglen, reinterpret_cast<char*>(&reply), rplen);
+  }
 }
 
 // send from value reference, receive into value reference
@@ -60,7 +88,31 @@ inline int ReplyValue(tid_t tid, null_reply_t) {
 }
 
 // reply from value reference
+// automatically fills in rplen; small replies are passed in registers
+template<class T>
+inline int ReplyValue(tid_t tid, const T& reply) {
+  auto rplen = sizeof(T);
+  if constexpr (is_short_message_v<T>) {
+    auto packed = to_short_message(reply);
+    return ReplyShort(tid, packed.words[0], packed.words[1], rplen);
+  } else {
+    return Reply(tid, reinterpret_cast<const char*>(&reply), rplen);
+  }
+}
+
+// reply from value reference
+// allows user to specify rplen
 template<class T>
-inline int ReplyValue(tid_t tid, const T& reply, size_t rplen = sizeof(T)) {
+inline int ReplyValue(tid_t tid, const T& reply, size_t rplen) {
   return Reply(tid, reinterpret_cast<const char*>(&reply), rplen);
 }
+
+// reply from value reference, then receive into value reference
+// reply_tid 0 skips the reply, so a server loop can start with nothing to reply to
+template<class T, class U>
+inline int ReplyReceiveValue(tid_t reply_tid, const T& reply, size_t rplen, tid_t& tid, U& msg, size_t msglen = sizeof(U)) {
+  return ReplyReceive(
+    reply_tid, reinterpret_cast<const char*>(&reply), rplen,
+    reinterpret_cast<int*>(&tid), reinterpret_cast<char*>(&msg), msglen
+  );
+}
@@ -5,64 +5,99 @@
 #include "kern/timer.hpp"
 #include "kern/irq.include"
 #include "kern/gpio.hpp"
+#include "kern/smp.hpp"
 
 void initialize() {
+#if !HOST_BUILD  // the c runtime of the host has already done this
   // run static/global constructors manually
   using constructor_t = void (*)();
   extern constructor_t __init_array_start[], __init_array_end[];
   for (auto* fn = __init_array_start; fn < __init_array_end; (*fn++)())
     ;
+#endif
 }
 
+#if !HOST_BUILD
 extern "C" int atexit(void (*)(void)) { return 0; }
 extern "C" void __assert_func(const char *, int, const char *, const char *) { __builtin_unreachable(); }
+#endif
 
 // bits[0:24] hold N in svc N
 #define ESR_MASK 0x1FFFFFF
+// bits[26:31] hold the exception class
+#define ESR_EC_SHIFT 26
+#define ESR_EC_FP_ACCESS 0x07
 
 uint32_t calculate_elapsed_time(uint32_t start_time, uint32_t end_time) {
   return end_time >= start_time ? end_time - start_time : start_time + ~end_time;
 }
 
-int main() {
-  initialize();
-  init_gpio();
-  init_spi(0);
-  init_uart(0);
+// what the kernel loops of every core share. it lives on the stack of main, which never returns
+// while other cores run
+struct kernel_state {
+  kernel::task_manager *task_manager;
+  kernel::timer *timer;
+  gpio::uart_interrupt_state *uart_irq_state;
+  // set once a task terminates the kernel, so every core stops
+  volatile bool terminating;
+};
 
-  // sets up the vector exception table
-  kernel::initialize();
-  kernel::enable_bcache();
-  kernel::timer timer;
-  timer.initialize();
-  kernel::task_manager task_manager;
-  kernel::context_t kernel_context;
-  gpio::uart_interrupt_state uart_irq_state;
+kernel_state *the_kernel = nullptr;
 
-  uart_puts(0, 0, SC_CLRSCR, LEN_LITERAL(SC_CLRSCR));
-  uart_puts(0, 0, SC_HIDCUR, LEN_LITERAL(SC_HIDCUR));
+// stops the other cores too
+int terminate_kernel(size_t core) {
+  the_kernel->terminating = true;
+  kernel::wake_cores(ALL_CORES & ~(1u << core));
+  kernel::unlock_kernel(core);
+  return 0;
+}
 
-  // spawn first task
-  auto *current_task = task_manager.new_task(KERNEL_TID, 1, PRIORITY_L2);
-  current_task->context.registers[0] = reinterpret_cast<int64_t>(k4::first_user_task);
-  current_task->context.exception_lr = reinterpret_cast<uint64_t>(task_wrapper);
-  task_manager.ready_push(current_task);
+// runs tasks on this core until there is nothing left, or a task terminates the kernel
+int run_kernel(size_t core) {
+  auto &task_manager = *the_kernel->task_manager;
+  auto &timer = *the_kernel->timer;
+  auto &uart_irq_state = *the_kernel->uart_irq_state;
+  // where this core saves itself while running a task
+  kernel::context_t kernel_context;
+  kernel::task_descriptor *current_task;
 
   uint64_t total_ticks = 0, kernel_ticks = 0, idle_ticks = 0;
 
+  kernel::lock_kernel(core);
   uint32_t start_time = timer.read_current_tick();
   uint32_t end_time, elapsed_time;
   uint32_t esr_el1, request;
-  while ((current_task = task_manager.get_task())) {
-    current_task->state = kernel::task_state_t::Active;
-
+  while (!the_kernel->terminating) {
+    current_task = task_manager.get_task(core);
+    if (!current_task) {
+#if SMP
+      // the idle task keeps core 0 busy. other cores sleep until a task is pushed to them,
+      // or one becomes ready that they may steal
+      kernel::unlock_kernel(core);
+      kernel::wait_for_interrupt();
+      kernel::lock_kernel(core);
+      end_time = timer.read_current_tick();
+      elapsed_time = calculate_elapsed_time(start_time, end_time);
+      total_ticks += elapsed_time;
+      idle_ticks += elapsed_time;
+      start_time = end_time;
+      kernel::handle_interrupt(task_manager, timer, uart_irq_state);
+      continue;
+#else
+      break;
+#endif
+    }
     end_time = timer.read_current_tick();
     elapsed_time = calculate_elapsed_time(start_time, end_time);
     total_ticks += elapsed_time;
     kernel_ticks += elapsed_time;
 
     start_time = end_time;
+    task_manager.prepare_fp(current_task);
+    task_manager.trace(trace_kind_t::DISPATCH, current_task->tid);
+    kernel::unlock_kernel(core);
     esr_el1 = kernel::activate_task(&kernel_context, current_task);
+    kernel::lock_kernel(core);
     end_time = timer.read_current_tick();
 
     elapsed_time = calculate_elapsed_time(start_time, end_time);
@@ -70,7 +105,10 @@ int main() {
 
     start_time = end_time;
 
-    request = esr_el1 & ESR_MASK;
+    request = (esr_el1 >> ESR_EC_SHIFT) == ESR_EC_FP_ACCESS ? FP_TRAP : esr_el1 & ESR_MASK;
+    task_manager.set_time(end_time);
+    task_manager.record_activation(current_task, elapsed_time, request);
+    task_manager.trace(trace_kind_t::SYSCALL, current_task->tid, request);
 
     switch (request) {
       case SYSCALLN_CREATE: {
@@ -101,10 +139,26 @@ int main() {
         task_manager.k_reply(current_task);
         break;
       }
+      case SYSCALLN_SENDSHORT: {
+        task_manager.k_send_short(current_task);
+        break;
+      }
+      case SYSCALLN_REPLYSHORT: {
+        task_manager.k_reply_short(current_task);
+        break;
+      }
+      case SYSCALLN_REPLYRECEIVE: {
+        task_manager.k_reply_receive(current_task);
+        break;
+      }
       case SYSCALLN_AWAITEVENT: {
         task_manager.k_await_event(current_task, uart_irq_state);
         break;
       }
+      case SYSCALLN_AWAITEVENTBUFFER: {
+        task_manager.k_await_event_buffer(current_task, uart_irq_state);
+        break;
+      }
       case SYSCALLN_EXIT: {
         task_manager.k_exit(current_task);
         break;
@@ -118,6 +172,29 @@ int main() {
         task_manager.ready_push(current_task);
         break;
       }
+      case SYSCALLN_SETALARM: {
+#if TICKLESS
+        timer.set_alarm(current_task->context.registers[0]);
+        current_task->context.registers[0] = 0;
+#else
+        // the periodic timer interrupts every tick anyway
+        current_task->context.registers[0] = -1;
+#endif
+        task_manager.ready_push(current_task);
+        break;
+      }
+      case SYSCALLN_TASKPROFILE: {
+        task_manager.k_task_profile(current_task);
+        break;
+      }
+      case SYSCALLN_SRRHISTOGRAM: {
+        task_manager.k_srr_histogram(current_task);
+        break;
+      }
+      case SYSCALLN_STACKUSAGE: {
+        task_manager.k_stack_usage(current_task);
+        break;
+      }
       case SYSCALLN_UARTREAD: {
         task_manager.k_uart_read(current_task);
         break;
@@ -130,12 +207,17 @@ int main() {
         task_manager.k_uart_write_n(current_task);
         break;
       }
+      case SYSCALLN_UARTREADN: {
+        task_manager.k_uart_read_n(current_task);
+        break;
+      }
       case SYSCALLN_SAVETHEPLANET: {
         // note: only the idle task should call this
         // also note that userspace is not able to call wfi
         // even though SCTLR_EL1 is configured to not trap wfi
-        asm volatile("dsb ish");
-        asm volatile("wfi");
+        kernel::unlock_kernel(core);
+        kernel::wait_for_interrupt();
+        kernel::lock_kernel(core);
         end_time = timer.read_current_tick();
         elapsed_time = calculate_elapsed_time(start_time, end_time);
 
@@ -143,6 +225,7 @@ int main() {
         idle_ticks += elapsed_time;
 
         start_time = end_time;
+        task_manager.set_time(end_time);
         kernel::handle_interrupt(task_manager, timer, uart_irq_state);
         task_manager.ready_push(current_task);
         break;
@@ -152,6 +235,10 @@ int main() {
         task_manager.ready_push(current_task);
         break;
       }
+      case FP_TRAP: {
+        task_manager.k_fp_trap(current_task);
+        break;
+      }
       // only for benchmarking
       case SYSBENCHMARK_ICACHE: {
         task_manager.kp_icache(current_task);
@@ -165,8 +252,53 @@ int main() {
         task_manager.kp_dcache(current_task);
         break;
       }
+      case SYSBENCHMARK_MMU: {
+        task_manager.kp_mmu(current_task);
+        break;
+      }
+      case SYSBENCHMARK_FRAMES: {
+        task_manager.kp_full_frames(current_task);
+        break;
+      }
+      case SYSCALLN_SETAFFINITY: {
+        task_manager.k_set_affinity(current_task);
+        break;
+      }
+      case SYSCALLN_LOOKUPNAME: {
+        task_manager.k_lookup_name(current_task);
+        break;
+      }
+      case SYSCALLN_PUBLISHNAME: {
+        task_manager.k_publish_name(current_task);
+        break;
+      }
+      case SYSCALLN_REGISTERCHANNEL: {
+        task_manager.k_register_channel(current_task);
+        break;
+      }
+      case SYSCALLN_AWAITCHANNEL: {
+        task_manager.k_await_channel(current_task);
+        break;
+      }
+      case SYSCALLN_SIGNALCHANNEL: {
+        task_manager.k_signal_channel(current_task);
+        break;
+      }
+      case SYSCALLN_SETPERIODIC: {
+        task_manager.k_set_periodic(current_task);
+        break;
+      }
+      case SYSCALLN_WAITNEXTPERIOD: {
+        task_manager.k_wait_next_period(current_task);
+        kernel::arm_next_release(task_manager, timer);
+        break;
+      }
+      case SYSCALLN_TRACEDUMP: {
+        task_manager.k_trace_dump(current_task);
+        break;
+      }
       case SYSCALLN_TERMINATE: {
-        return 0;
+        return terminate_kernel(core);
       }
       default: {
         // in case the kernel does not recognize the request, print it and return
@@ -176,11 +308,66 @@ int main() {
           esr_el1 >>= 1;
         }
         uart_puts(0, 0, "\r\n", 2);
-        return 0;
+        return terminate_kernel(core);
       }
     }
   }
-  uart_puts(0, 0, "Finished processing all tasks!\r\n", 32);
-  uart_puts(0, 0, SC_SHWCUR, LEN_LITERAL(SC_SHWCUR));
+  kernel::unlock_kernel(core);
+  return 0;
+}
+
+#if SMP
+// where secondary_start in boot.S lands after the firmware releases a core
+extern "C" void secondary_main(size_t core) {
+  kernel::initialize_secondary_core();
+#if !MMU
+  // otherwise boot.S turned on the mmu and both caches, which enable_bcache() would undo
+  kernel::enable_bcache();
+#endif
+  run_kernel(core);
+  // the main core reboots the board
+  for (;;) {
+    kernel::wait_for_interrupt();
+  }
+}
+#endif
+
+int main() {
+  initialize();
+  init_gpio();
+  init_spi(0);
+  init_uart(0);
+
+  // sets up the vector exception table
+  kernel::initialize();
+#if !MMU
+  kernel::enable_bcache();
+#endif
+  kernel::timer timer;
+  timer.initialize();
+  kernel::task_manager task_manager;
+  gpio::uart_interrupt_state uart_irq_state;
+  kernel_state state {&task_manager, &timer, &uart_irq_state, false};
+  the_kernel = &state;
+
+  uart_puts(0, 0, SC_CLRSCR, LEN_LITERAL(SC_CLRSCR));
+  uart_puts(0, 0, SC_HIDCUR, LEN_LITERAL(SC_HIDCUR));
+
+  task_manager.set_time(timer.read_current_tick());
+
+  // spawn first task
+  auto *first_task = task_manager.new_task(KERNEL_TID, PRIORITY_L2);
+  first_task->context.registers[0] = reinterpret_cast<int64_t>(k4::first_user_task);
+  first_task->context.exception_lr = reinterpret_cast<uint64_t>(task_wrapper);
+  task_manager.ready_push(first_task);
+
+#if SMP
+  kernel::start_secondary_cores();
+#endif
+  run_kernel(0);
+  if (!state.terminating) {
+    uart_puts(0, 0, "Finished processing all tasks!\r\n", 32);
+    uart_puts(0, 0, SC_SHWCUR, LEN_LITERAL(SC_SHWCUR));
+  }
   return 0;
 }
@@ -26,8 +26,21 @@ void switch_task() {
   buffer.header = tc_msg_header::SWITCH_CMD_PART_1;
   int turn_off_counts = 0;
 
+  auto change_switch = [&] () {
+    tc_reply reply;
+    int replylen = SendValue(train_controller, buffer, reply);
+    if (replylen == 1 && reply == tc_reply::OK) {
+      ++turn_off_counts;
+      ReplyValue(expire_timer, tc_reply::OK);
+    }
+  };
+
+  // a bare switch_cmd, or a batch of them from the traffic server's courier
+  utils::enumed_class<tc_msg_header, char[MAX_BATCH_SIZE]> request;
+
   while (1) {
-    if (ReceiveValue(request_tid, buffer.data) <= 0) {
+    int len = ReceiveValue(request_tid, request);
+    if (len <= 0) {
       continue;
     }
     if (request_tid == expire_timer) {
@@ -37,14 +50,18 @@ void switch_task() {
       } else if (turn_off_counts) {
         ReplyValue(request_tid, tc_reply::OK);
       }
-    } else {
-      tc_reply reply;
-      int replylen = SendValue(train_controller, buffer, reply);
+    } else if (len == sizeof(switch_cmd)) {
+      __builtin_memcpy(&buffer.data, &request, sizeof(switch_cmd));
+      change_switch();
       ReplyValue(request_tid, tc_reply::OK);
-      if (replylen == 1 && reply == tc_reply::OK) {
-        ++turn_off_counts;
-        ReplyValue(expire_timer, tc_reply::OK);
-      }
+    } else if (request.header == tc_msg_header::BATCH) {
+      ReplyValue(request_tid, tc_reply::OK);
+      utils::for_each_batched(request.data, len - offsetof(decltype(request), data), [&] (const char *data, size_t cmd_len) {
+        if (cmd_len == sizeof(switch_cmd)) {
+          __builtin_memcpy(&buffer.data, data, sizeof(switch_cmd));
+          change_switch();
+        }
+      });
     }
   }
 }
@@ -116,6 +133,9 @@ void sensor_task() {
 
   char sensor_bytes[10] = {0};
 
+  // the dump alone takes ~50ms at 2400 baud, so this keeps the old 60ms gap between polls
+  // while leaving the line some room for commands
+  SetPeriodic(110 * 1000, 0);
   while (1) {
     int replylen = SendValue(train_controller, tc_msg_header::SENSOR_CMD, sensor_bytes);
     int tick = Time(clock_server());
@@ -143,7 +163,7 @@ void sensor_task() {
       }
     }
 
-    Delay(clock_server(), 6); // 60ms
+    WaitNextPeriod();
   }
 }
 
@@ -161,7 +181,7 @@ void train_task() {
   Create(PRIORITY_L2, reverse_task);
 
   tid_t request_tid;
-  utils::enumed_class<tc_msg_header, char[128]> message {};
+  utils::enumed_class<tc_msg_header, char[MAX_BATCH_SIZE]> message {};
 
   // TODO: get rid of this
   int train_speeds[81];
@@ -177,15 +197,23 @@ void train_task() {
     switch_directions[i] = switch_dir_t::NONE;
   }
 
-  auto send_train_speed = [&train_speeds, &merklin_tx, &traffic_task, &request_tid] (int train_num, int speed, bool reply_speed = false) {
+  // commands of a batch get one reply for all of them, before they are carried out
+  bool in_batch = false;
+  auto reply = [&request_tid, &in_batch] (auto const &value) {
+    if (!in_batch) {
+      ReplyValue(request_tid, value);
+    }
+  };
+
+  auto send_train_speed = [&train_speeds, &merklin_tx, &traffic_task, &reply] (int train_num, int speed, bool reply_speed = false) {
     Putc(merklin_tx(), 1, (char)speed);
     Putc(merklin_tx(), 1, (char)train_num);
 
     if (reply_speed) {
-      ReplyValue(request_tid, speed);
+      reply(speed);
     } else {
       // track task may send cmds back to me so unblock it first
-      ReplyValue(request_tid, tc_reply::OK);
+      reply(tc_reply::OK);
     }
 
     utils::enumed_class traffic_msg {
@@ -195,31 +223,28 @@ void train_task() {
     SendValue(traffic_task(), traffic_msg, null_reply);
   };
 
-  while (1) {
-    int request = ReceiveValue(request_tid, message);
-    if (request <= 0) continue;
-
-    switch (message.header) {
+  auto handle = [&] (decltype(message) &command) {
+    switch (command.header) {
       case tc_msg_header::REVERSE_CMD_PART_1: {
-        auto &cmd = message.data_as<reverse_cmd>();
+        auto &cmd = command.data_as<reverse_cmd>();
         int train_num = cmd.train;
 
         if (!is_train_reversing[train_num]) {
           send_train_speed(train_num, train_speeds[train_num] >= 16 ? 16 : 0, true);
           is_train_reversing[train_num] = true;
         } else {
-          ReplyValue(request_tid, tc_reply::TRAIN_ALREADY_REVERSING);
+          reply(tc_reply::TRAIN_ALREADY_REVERSING);
         }
         break;
       }
       case tc_msg_header::REVERSE_CMD_PART_2: {
-        auto &cmd = message.data_as<reverse_cmd>();
+        auto &cmd = command.data_as<reverse_cmd>();
         int train_num = cmd.train;
         send_train_speed(train_num, 15);
         break;
       }
       case tc_msg_header::REVERSE_CMD_PART_3: {
-        auto &cmd = message.data_as<reverse_cmd>();
+        auto &cmd = command.data_as<reverse_cmd>();
         int train_num = cmd.train;
 
         send_train_speed(train_num, train_speeds[train_num]);
@@ -232,18 +257,18 @@ void train_task() {
         for (int i = 0; i < 10; ++i) {
           sensor_bytes[i] = Getc(merklin_rx(), 1);
         }
-        ReplyValue(request_tid, sensor_bytes);
+        reply(sensor_bytes);
         break;
       }
       case tc_msg_header::SWITCH_CMD_PART_1: {
-        auto &cmd = message.data_as<switch_cmd>();
+        auto &cmd = command.data_as<switch_cmd>();
         if (switch_directions[cmd.switch_num] == cmd.switch_dir) {
-          ReplyValue(request_tid, tc_reply::SWITCH_UNCHANGED);
+          reply(tc_reply::SWITCH_UNCHANGED);
         } else {
           Putc(merklin_tx(), 1, (char)(cmd.switch_dir));
           Putc(merklin_tx(), 1, (char)(cmd.switch_num));
           switch_directions[cmd.switch_num] = cmd.switch_dir;
-          ReplyValue(request_tid, tc_reply::OK);
+          reply(tc_reply::OK);
           //
           SendValue(traffic_task(), utils::enumed_class {
             traffic::traffic_msg_header::SWITCH_CMD,
@@ -255,11 +280,11 @@ void train_task() {
       }
       case tc_msg_header::SWITCH_CMD_PART_2: {
         Putc(merklin_tx(), 1, static_cast<char>(special_cmd::TURNOFF_SWITCH));
-        ReplyValue(request_tid, tc_reply::OK);
+        reply(tc_reply::OK);
         break;
       }
       case tc_msg_header::SPEED: {
-        auto &cmd = message.data_as<speed_cmd>();
+        auto &cmd = command.data_as<speed_cmd>();
         int speed = cmd.speed;
         int train_num = cmd.train;
 
@@ -267,22 +292,40 @@ void train_task() {
           train_speeds[train_num] = speed;
           send_train_speed(train_num, speed);
         } else {
-          ReplyValue(request_tid, tc_reply::TRAIN_ALREADY_REVERSING);
+          reply(tc_reply::TRAIN_ALREADY_REVERSING);
         }
         break;
       }
       case tc_msg_header::GO_CMD: {
         Putc(merklin_tx(), 1, static_cast<char>(special_cmd::GO));
-        ReplyValue(request_tid, tc_reply::OK);
+        reply(tc_reply::OK);
         break;
       }
       case tc_msg_header::SET_RESET_MODE: {
         Putc(merklin_tx(), 1, static_cast<char>(special_cmd::RESET_MODE));
-        ReplyValue(request_tid, tc_reply::OK);
+        reply(tc_reply::OK);
         break;
       }
       default: break;
     }
+  };
+
+  while (1) {
+    int request = ReceiveValue(request_tid, message);
+    if (request <= 0) continue;
+
+    if (message.header == tc_msg_header::BATCH) {
+      ReplyValue(request_tid, tc_reply::OK);
+      in_batch = true;
+      utils::for_each_batched(message.data, request - offsetof(decltype(message), data), [&] (const char *data, size_t len) {
+        decltype(message) command;
+        __builtin_memcpy(&command, data, len < sizeof command ? len : sizeof command);
+        handle(command);
+      });
+      in_batch = false;
+      continue;
+    }
+    handle(message);
   }
 }
 
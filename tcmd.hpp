@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 // old name: trains
@@ -26,8 +27,14 @@ enum class tc_msg_header : uint64_t {
   GO_CMD = 'g',
 
   SET_RESET_MODE = 'm',
+
+  // commands queued by a courier, see utils::for_each_batched()
+  BATCH = 'b',
 };
 
+// bytes of commands in one BATCH message
+static constexpr size_t MAX_BATCH_SIZE = 248;
+
 struct reverse_cmd {
   int train;
 };
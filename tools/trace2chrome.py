@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+converts the kernel trace that the `trace` command streams over the terminal (uart 0)
+into chrome trace_event json, for chrome://tracing or https://ui.perfetto.dev
+
+    trace2chrome.py capture.bin > trace.json
+
+capture.bin is everything the terminal received, escape sequences of the display
+included; only the frames of the trace are picked out of it. a frame is the magic
+"TRCE", a little endian uint32 count, and that many trace_record_t of
+kern/kstddefs.hpp.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+MAGIC = b'TRCE'
+RECORD = struct.Struct('<IIBBH')  # trace_record_t
+MAX_FRAME_RECORDS = 64
+
+# trace_kind_t
+DISPATCH, SYSCALL, INTERRUPT, WAKEUP, RELEASE, SIGNAL = range(6)
+
+# events_t
+EVENTS = ['TIMER', 'UART_R0', 'UART_T0', 'UART_R1', 'UART_T1', 'CTS_1']
+
+KERN = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'kern')
+
+
+def syscall_names():
+    """request numbers to names, from the same headers the kernel is built with."""
+    names = {}
+    for header, prefix in (('user_syscall.include', 'SYSCALLN_'), ('irq.include', '')):
+        try:
+            with open(os.path.join(KERN, header)) as f:
+                for m in re.finditer(r'^#define\s+(\w+)\s+(\d+)\s*$', f.read(), re.M):
+                    names[int(m.group(2))] = m.group(1)[len(prefix):] if m.group(1).startswith(prefix) else m.group(1)
+        except OSError:
+            pass
+    return names
+
+
+def read_records(data):
+    """the records of every frame in data, in order."""
+    records = []
+    i = data.find(MAGIC)
+    while i >= 0:
+        start = i + len(MAGIC) + 4
+        if start > len(data):
+            break
+        (count,) = struct.unpack_from('<I', data, i + len(MAGIC))
+        end = start + count * RECORD.size
+        if count > MAX_FRAME_RECORDS or end > len(data):
+            # the magic happened to be in other output, or the capture was cut off
+            i = data.find(MAGIC, i + 1)
+            continue
+        records.extend(RECORD.unpack_from(data, start + n * RECORD.size) for n in range(count))
+        i = data.find(MAGIC, end)
+    return records
+
+
+def convert(records):
+    names = syscall_names()
+    events = []
+    # the task running on each core, and since when
+    running = {}
+    tids = set()
+    last = None
+    offset = 0
+
+    for time, tid, kind, core, arg in records:
+        # the system timer is 32 bits of microseconds and wraps every ~71 minutes
+        if last is not None and time + offset < last - (1 << 31):
+            offset += 1 << 32
+        ts = time + offset
+        last = ts
+
+        if kind == DISPATCH:
+            running[core] = (tid, ts)
+            tids.add((core, tid))
+        elif kind == SYSCALL:
+            name = names.get(arg, 'request %d' % arg)
+            prev = running.pop(core, None)
+            if prev and prev[0] == tid:
+                events.append({'name': 'run', 'ph': 'X', 'pid': core, 'tid': tid,
+                               'ts': prev[1], 'dur': ts - prev[1], 'args': {'until': name}})
+            events.append({'name': name, 'ph': 'i', 's': 't', 'pid': core, 'tid': tid, 'ts': ts})
+            tids.add((core, tid))
+        elif kind == INTERRUPT:
+            events.append({'name': 'irq %d' % arg, 'ph': 'i', 's': 't', 'pid': core, 'tid': 0, 'ts': ts})
+            tids.add((core, 0))
+        else:
+            if kind == WAKEUP:
+                name = 'wakeup ' + (EVENTS[arg] if arg < len(EVENTS) else str(arg))
+            elif kind == RELEASE:
+                name = 'release'
+            else:
+                name = 'signal channel %d' % arg
+            events.append({'name': name, 'ph': 'i', 's': 't', 'pid': core, 'tid': tid, 'ts': ts})
+            tids.add((core, tid))
+
+    for core in sorted({core for core, _ in tids}):
+        events.append({'name': 'process_name', 'ph': 'M', 'pid': core, 'args': {'name': 'core %d' % core}})
+    for core, tid in sorted(tids):
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': core, 'tid': tid,
+                       'args': {'name': 'kernel' if tid == 0 else 'task %d' % tid}})
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('capture', help='bytes received from uart 0')
+    parser.add_argument('-o', '--output', help='json file to write, stdout by default')
+    args = parser.parse_args()
+
+    with open(args.capture, 'rb') as f:
+        records = read_records(f.read())
+    if not records:
+        sys.exit('no trace frames in ' + args.capture)
+    trace = convert(records)
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+    print('%d records' % len(records), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
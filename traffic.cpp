@@ -1,6 +1,7 @@
 #include <fpm/math.hpp>
 #include "traffic.hpp"
 #include "kern/user_syscall_typed.hpp"
+#include "kern/pubsub.hpp"
 #include "ui.hpp"
 #include "traffic_mini_driver.hpp"
 #include "traffic_collision.hpp"
@@ -35,21 +36,21 @@ namespace traffic {
       }
     }
 
-    void send_train_ui_msg(const internal_train_state &train) {
+    ui::train_read make_train_read(const internal_train_state &train) {
       auto &driver = drivers.at(train.num);
-      utils::enumed_class msg {
-        ui::display_msg_header::TRAIN_READ,
-        ui::train_read {
-          train.num,
-          train.cmd,
-          driver.dest,  // dest
-          train.tick_snap.pos,  // curr pos
-          train.tick_snap.speed,  // curr speed
-          train.sn_delta_t,
-          train.sn_delta_d,
-        },
+      return {
+        train.num,
+        train.cmd,
+        driver.dest,  // dest
+        train.tick_snap.pos,  // curr pos
+        train.tick_snap.speed,  // curr speed
+        train.sn_delta_t,
+        train.sn_delta_d,
       };
-      ui::out().send_value(msg);
+    }
+
+    void send_train_ui_msg(const internal_train_state &train) {
+      ui::train_reads().publish(make_train_read(train));
     }
 
     void handle_speed_cmd(int current_tick, speed_cmd &cmd) {
@@ -107,16 +108,13 @@ namespace traffic {
       train.cmd = cmd.speed;
       // package information and send to display controller
       send_train_ui_msg(train);
+      // predictions only go to the display, but commands are worth a message to anyone
+      pubsub::Publish(pubsub_server(), pubsub::topic_t::TRAIN_STATE, make_train_read(train));
     }
 
     void handle_switch_cmd(switch_cmd &cmd) {
       switches.status.at(cmd.switch_num) = cmd.switch_dir;
-      // forward to display controller
-      utils::enumed_class msg {
-        ui::display_msg_header::SWITCHES,
-        ui::switch_read { cmd.switch_num, cmd.switch_dir },
-      };
-      ui::out().send_value(msg);
+      pubsub::Publish(pubsub_server(), pubsub::topic_t::SWITCH, cmd);
     }
 
     void handle_sensor_read(sensor_read &read) {
@@ -125,12 +123,7 @@ namespace traffic {
           send_train_ui_msg(*train_ptr);
         }
       }
-      // forward to display controller
-      utils::enumed_class msg {
-        ui::display_msg_header::SENSOR_MSG,
-        ui::sensor_read { read.sensor, read.tick },
-      };
-      ui::out().send_value(msg);
+      pubsub::Publish(pubsub_server(), pubsub::topic_t::SENSOR, read);
     }
 
     /**
@@ -391,6 +384,10 @@ namespace traffic {
      * runner for collision avoidance.
      */
     collision_avoider assist {&initialized_trains, &drivers, &switches.status};
+    /**
+     * where sensor, switch and train state updates are published to.
+     */
+    decltype(TaskFinder("")) pubsub_server {TaskFinder(pubsub::PUBSUB_SERVER_NAME)};
   };
 
   void traffic_server() {
@@ -463,16 +460,18 @@ namespace traffic {
 
   void predict_timer() {
     auto traffic_server = TaskFinder(TRAFFIC_SERVER_TASK_NAME);
-    auto clock_server = TaskFinder("clock_server");
+    // released by the kernel, so the interval does not drift by the time of the send
+    SetPeriodic(predict_react_interval * TIMER_INTERRUPT_INTERVAL / NUM_TICKS_IN_1US, 0);
     while (true) {
-      DelayUntil(clock_server(), Time(clock_server()) + predict_react_interval);
+      WaitNextPeriod();
       SendValue(traffic_server(), traffic_msg_header::TRAIN_PREDICT, null_reply);
     }
   }
 
   void init_tasks() {
     Create(priority_t::PRIORITY_L1, predict_timer);
-    Create(priority_t::PRIORITY_L1, traffic_server);
+    // path finding runs long, keep it off the core taking interrupts
+    SetAffinity(Create(priority_t::PRIORITY_L1, traffic_server), NON_IRQ_CORES);
   }
 
 } // namespace traffic
@@ -5,11 +5,21 @@
 
 namespace traffic {
 
+  // bursts of commands are carried in one round trip
   using train_courier_t = utils::courier_runner<
     traffic_msg_header::TO_TC_COURIER,
-    sizeof(utils::enumed_class<tcmd::tc_msg_header, tcmd::speed_cmd>)
+    sizeof(utils::enumed_class<tcmd::tc_msg_header, tcmd::speed_cmd>),
+    30,
+    tcmd::tc_msg_header::BATCH,
+    tcmd::MAX_BATCH_SIZE
+  >;
+  using switch_courier_t = utils::courier_runner<
+    traffic_msg_header::TO_SWITCH_COURIER,
+    sizeof(switch_cmd),
+    30,
+    tcmd::tc_msg_header::BATCH,
+    tcmd::MAX_BATCH_SIZE
   >;
-  using switch_courier_t = utils::courier_runner<traffic_msg_header::TO_SWITCH_COURIER, sizeof(switch_cmd)>;
 
   /**
    * simulates the driver of one train.
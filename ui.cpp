@@ -4,9 +4,11 @@
 #include <troll_util/utils.hpp>
 #include "ui.hpp"
 #include "kern/gtkterm.hpp"
+#include "kern/pubsub.hpp"
 #include "kern/kstddefs.hpp"
 #include "tcmd.hpp"
 #include "kern/rpi.hpp"
+#include "kern/srr_histogram.hpp"
 #include "track_consts.hpp"
 
 namespace ui {
@@ -16,6 +18,66 @@ ui_sender &out() {
   return sender;
 }
 
+train_reads_channel &train_reads() {
+  static train_reads_channel channel;
+  return channel;
+}
+
+namespace {
+
+/**
+ * wakes the display controller when train reads come in after the ring ran empty.
+ */
+void train_reads_notifier() {
+  auto &reads = train_reads();
+  reads.channel = RegisterChannel();
+  auto display_controller = TaskFinder(DISPLAY_CONTROLLER_NAME);
+  const auto header = display_msg_header::TRAIN_READ;
+  while (1) {
+    if (reads.ring.prepare_wait()) {
+      AwaitChannel(reads.channel);
+    }
+    // the display controller replies once it emptied the ring
+    SendValue(display_controller(), header, null_reply);
+  }
+}
+
+static constexpr size_t TRACE_FRAME_RECORDS = 64;
+
+// records of the kernel trace as they go out on the terminal. tools/trace2chrome.py
+// picks the frames out of everything else the terminal receives
+struct trace_frame {
+  char magic[4] {'T', 'R', 'C', 'E'};
+  uint32_t num_records;
+  trace_record_t records[TRACE_FRAME_RECORDS];
+};
+
+/**
+ * streams what the kernel trace holds out over the terminal, then exits.
+ */
+void trace_dump_task() {
+  auto gtkterm_tx = WhoIs(gtkterm::GTK_TX_SERVER_NAME);
+  auto clock_server = WhoIs("clock_server");
+  trace_frame frame;
+  // the trace keeps filling up while it is sent, by this task too. so stop once it ran
+  // empty, or after one buffer full
+  for (size_t sent = 0; sent < TRACE_BUFFER_SIZE; sent += frame.num_records) {
+    frame.num_records = TraceDump(frame.records, TRACE_FRAME_RECORDS);
+    if (!frame.num_records) {
+      break;
+    }
+    Puts(gtkterm_tx, 0, reinterpret_cast<const char *>(&frame),
+         offsetof(trace_frame, records) + frame.num_records * sizeof(trace_record_t));
+    if (frame.num_records < TRACE_FRAME_RECORDS) {
+      break;
+    }
+    // the tx server queues without pushing back, and a full frame takes ~70ms at 115200 baud
+    Delay(clock_server, 7);
+  }
+}
+
+}  // namespace
+
 const char *manual[] = {
   "Manual",
   "tr <train_num> <speed_level>           Set train command",
@@ -26,6 +88,9 @@ const char *manual[] = {
   "goto <train_num> <node_name> <offset>  Make train go to a position",
   "st                                     Stop all trains",
   "q                                      Quit",
+  "lat <sender> <receiver>                Send-reply latency (BENCHMARKING builds)",
+  "stk <tid>                              Stack high water mark of a task",
+  "trace                                  Dump the kernel trace (TRACING builds)",
   "",
   "This program was compiled on " __DATE__ " " __TIME__ " for track "
 #if IS_TRACK_A == 1
@@ -62,6 +127,10 @@ void display_controller_task() {
 
   RegisterAs(DISPLAY_CONTROLLER_NAME);
   auto gtkterm_tx = TaskFinder(gtkterm::GTK_TX_SERVER_NAME);
+  // sensor and switch updates come from couriers of the pubsub server
+  auto pubsub_server = TaskFinder(pubsub::PUBSUB_SERVER_NAME);
+  pubsub::Subscribe(pubsub_server(), pubsub::topic_t::SENSOR, display_msg_header::SENSOR_MSG);
+  pubsub::Subscribe(pubsub_server(), pubsub::topic_t::SWITCH, display_msg_header::SWITCHES);
 
   tid_t request_tid;
 
@@ -240,6 +309,22 @@ void display_controller_task() {
     takeover.enqueue(row++, train_lock_col, sv.data());
   }
 
+  // top tasks by cpu usage
+  constexpr size_t top_tasks_row = 13;
+  constexpr size_t top_tasks_col = 80;
+  auto top_tasks_cell = [](auto value) {
+    return pad<8>(sformat<8>("{}", value), padding::left);
+  };
+  // tids carry their generation, and dispatch counts grow quickly
+  auto top_tasks_wide_cell = [](auto value) {
+    return pad<11>(sformat<11>("{}", value), padding::left);
+  };
+  takeover.enqueue(top_tasks_row, top_tasks_col, sformat<50>(
+    "{}{}{}{}{}",
+    top_tasks_wide_cell("Task"), top_tasks_cell("Run%"), top_tasks_cell("Ready%"),
+    top_tasks_cell("Block%"), top_tasks_wide_cell("Disp.")
+  ).data());
+
   utils::enumed_class<display_msg_header, char[256]> message;
   const char reply = 'o';
 
@@ -279,6 +364,23 @@ void display_controller_task() {
         ReplyValue(request_tid, reply);
         break;
       }
+      case display_msg_header::TOP_TASKS: {
+        ReplyValue(request_tid, reply);
+        auto &top = message.data_as<top_tasks_t>();
+        for (size_t i = 0; i < NUM_TOP_TASKS; ++i) {
+          ::etl::string<50> line;
+          if (i < top.num_tasks) {
+            auto &usage = top.tasks[i];
+            line = sformat<50>(
+              "{}{}{}{}{}",
+              top_tasks_wide_cell(usage.tid), top_tasks_cell(usage.run), top_tasks_cell(usage.ready),
+              top_tasks_cell(usage.blocked), top_tasks_wide_cell(usage.dispatches)
+            );
+          }
+          takeover.enqueue(top_tasks_row + 1 + i, top_tasks_col, pad<50>(line, padding::left).data());
+        }
+        break;
+      }
       case display_msg_header::SWITCHES: { // we assume that only changing active switches will go through here
         auto &cmd = message.data_as<ui::switch_read>();
         char dir = cmd.switch_dir == tcmd::switch_dir_t::C ? 'C' : 'S';
@@ -318,23 +420,25 @@ void display_controller_task() {
         ReplyValue(request_tid, reply);
         break;
       }
-      case display_msg_header::TRAIN_READ: { // train status update
+      case display_msg_header::TRAIN_READ: { // train status updates
+        train_read tr;
+        while (train_reads().ring.pop(tr)) {
+          auto idx = get_train_patch_idx(tr.num);
+          // patch the table
+          auto [row1, col1, patch1] = train_tab.patch_str<1>(idx, tr.cmd);
+          takeover.enqueue(row1 + train_table_row, col1 + col_offset, patch1.data());
+          auto [row2, col2, patch2] = train_tab.patch_str<2>(idx, stringify_pos(tr.dest));
+          takeover.enqueue(row2 + train_table_row, col2 + col_offset, patch2.data());
+          auto [row3, col3, patch3] = train_tab.patch_str<3>(idx, tr.speed);
+          takeover.enqueue(row3 + train_table_row, col3 + col_offset, patch3.data());
+          auto [row4, col4, patch4] = train_tab.patch_str<4>(idx, stringify_pos(tr.pos));
+          takeover.enqueue(row4 + train_table_row, col4 + col_offset, patch4.data());
+          auto [row5, col5, patch5] = train_tab.patch_str<5>(idx, tr.delta_t);
+          takeover.enqueue(row5 + train_table_row, col5 + col_offset, patch5.data());
+          auto [row6, col6, patch6] = train_tab.patch_str<6>(idx, tr.delta_d);
+          takeover.enqueue(row6 + train_table_row, col6 + col_offset, patch6.data());
+        }
         ReplyValue(request_tid, null_reply);
-        auto &tr = message.data_as<train_read>();
-        auto idx = get_train_patch_idx(tr.num);
-        // patch the table
-        auto [row1, col1, patch1] = train_tab.patch_str<1>(idx, tr.cmd);
-        takeover.enqueue(row1 + train_table_row, col1 + col_offset, patch1.data());
-        auto [row2, col2, patch2] = train_tab.patch_str<2>(idx, stringify_pos(tr.dest));
-        takeover.enqueue(row2 + train_table_row, col2 + col_offset, patch2.data());
-        auto [row3, col3, patch3] = train_tab.patch_str<3>(idx, tr.speed);
-        takeover.enqueue(row3 + train_table_row, col3 + col_offset, patch3.data());
-        auto [row4, col4, patch4] = train_tab.patch_str<4>(idx, stringify_pos(tr.pos));
-        takeover.enqueue(row4 + train_table_row, col4 + col_offset, patch4.data());
-        auto [row5, col5, patch5] = train_tab.patch_str<5>(idx, tr.delta_t);
-        takeover.enqueue(row5 + train_table_row, col5 + col_offset, patch5.data());
-        auto [row6, col6, patch6] = train_tab.patch_str<6>(idx, tr.delta_d);
-        takeover.enqueue(row6 + train_table_row, col6 + col_offset, patch6.data());
         break;
       }
       case display_msg_header::SENSOR_LOCK:
@@ -506,6 +610,41 @@ void command_controller_task() {
           }, reply);
           valid = reply == traffic::traffic_reply_msg::OK;
         }
+      } else if (troll::sscan(command_buffer.data, curr_size, "lat {} {}", arg1, arg2)) {
+        static srr_histogram_t histograms[MAX_SRR_PAIRS];
+        int num_histograms = SrrHistogram(histograms, MAX_SRR_PAIRS);
+        valid = true;
+        if (!num_histograms) {
+          out().send_notice("No latency data (build with BENCHMARKING=1).");
+        }
+        for (int i = 0; i < num_histograms; ++i) {
+          auto &h = histograms[i];
+          if (h.sender == arg1 && h.receiver == arg2) {
+            // timer ticks are microseconds
+            out().send_notice(troll::sformat<80>(
+              "{}->{}: n={} p50<={}us p99<={}us max={}us",
+              arg1, arg2, h.latency.count, h.latency.percentile(50), h.latency.percentile(99), h.latency.max
+            ));
+            break;
+          } else if (i == num_histograms - 1) {
+            out().send_notice("No transactions recorded between these tasks.");
+          }
+        }
+      } else if (troll::sscan(command_buffer.data, curr_size, "stk {}", arg1)) {
+        stack_usage_t usage;
+        if (StackUsage(arg1, &usage) == 0) {
+          valid = true;
+          out().send_notice(troll::sformat<80>(
+            "Task {}: {} of {} bytes of stack used", arg1, usage.high_water, usage.size
+          ));
+        }
+      } else if (troll::sscan(command_buffer.data, curr_size, "trace")) {
+        valid = true;
+        if (!TRACING) {
+          out().send_notice("No trace (build with TRACING=1).");
+        } else if (Create(priority_t::PRIORITY_L5, trace_dump_task) < 0) {
+          valid = false;
+        }
       } else if (curr_size == 1 && command_buffer.data[0] == 'q') {
         Terminate();
       }
@@ -567,6 +706,68 @@ void timer_task() {
   }
 }
 
+namespace {
+  // counters of a task at the last sample
+  struct task_sample_t {
+    tid_t tid;
+    uint64_t run, ready, blocked, dispatches;
+  };
+
+  uint32_t percent_of(uint64_t part, uint64_t total) {
+    return total ? part * 100 / total : 0;
+  }
+
+  /**
+   * fills in the tasks that ran the most since the last sample, and updates the samples.
+   */
+  void sample_top_tasks(
+    task_profile_t const *profiles, size_t num_profiles, task_sample_t *samples,
+    uint64_t elapsed_ticks, top_tasks_t &top
+  ) {
+    using kernel::task_state_t;
+    constexpr auto ready_state = static_cast<size_t>(task_state_t::Ready);
+
+    uint64_t top_run[NUM_TOP_TASKS];
+    top.num_tasks = 0;
+    for (size_t i = 0; i < num_profiles; ++i) {
+      auto &profile = profiles[i];
+      uint64_t blocked = 0;
+      for (size_t s = static_cast<size_t>(task_state_t::Blocked); s < NUM_TASK_STATES; ++s) {
+        blocked += profile.state_ticks[s];
+      }
+
+      // a slot that now holds another task starts from zero
+      auto &sample = samples[tid_index(profile.tid)];
+      if (sample.tid != profile.tid) {
+        sample = {profile.tid, 0, 0, 0, 0};
+      }
+      uint64_t run = profile.run_ticks - sample.run;
+      task_usage_t usage {
+        profile.tid,
+        percent_of(run, elapsed_ticks),
+        percent_of(profile.state_ticks[ready_state] - sample.ready, elapsed_ticks),
+        percent_of(blocked - sample.blocked, elapsed_ticks),
+        static_cast<uint32_t>(profile.dispatches - sample.dispatches),
+      };
+      sample = {profile.tid, profile.run_ticks, profile.state_ticks[ready_state], blocked, profile.dispatches};
+
+      // keep the list sorted by run time, dropping whatever falls off the end
+      size_t pos = top.num_tasks < NUM_TOP_TASKS ? top.num_tasks++ : NUM_TOP_TASKS;
+      while (pos > 0 && top_run[pos - 1] < run) {
+        if (pos < NUM_TOP_TASKS) {
+          top.tasks[pos] = top.tasks[pos - 1];
+          top_run[pos] = top_run[pos - 1];
+        }
+        --pos;
+      }
+      if (pos < NUM_TOP_TASKS) {
+        top.tasks[pos] = usage;
+        top_run[pos] = run;
+      }
+    }
+  }
+}  // namespace
+
 // todo: move this somewhere else
 void idle_task() {
   time_percentage_t prev_percentages = {0, 0, 0};
@@ -577,6 +778,12 @@ void idle_task() {
   message.header = display_msg_header::IDLE_MSG;
   size_t entries = 10;
 
+  task_profile_t profiles[MAX_NUM_TASKS];
+  task_sample_t samples[MAX_NUM_TASKS] {};
+  utils::enumed_class<display_msg_header, top_tasks_t> top_message;
+  top_message.header = display_msg_header::TOP_TASKS;
+  uint64_t last_top_ticks = 0;
+
   while (1) {
     --entries;
     // only print every 10 entries to the idle task to save the planet even more
@@ -599,6 +806,14 @@ void idle_task() {
         out().send_value(message);
         prev_percentages = curr_percentages;
       }
+
+      // the task table is redrawn at most once per second to not flood the terminal
+      if (td.total_ticks - last_top_ticks >= TIMER_FREQ) {
+        size_t num_profiles = TaskProfile(profiles, MAX_NUM_TASKS);
+        sample_top_tasks(profiles, num_profiles, samples, td.total_ticks - last_top_ticks, top_message.data);
+        out().send_value(top_message);
+        last_top_ticks = td.total_ticks;
+      }
     }
     SaveThePlanet();
   }
@@ -653,7 +868,9 @@ void initialize() {
 }
 
 void init_tasks() {
-  Create(priority_t::PRIORITY_L4, display_controller_task);
+  // drawing is the heaviest user work, so it stays off the core taking interrupts
+  SetAffinity(Create(priority_t::PRIORITY_L4, display_controller_task), NON_IRQ_CORES);
+  SetAffinity(Create(priority_t::PRIORITY_L3, train_reads_notifier), NON_IRQ_CORES);
   Create(priority_t::PRIORITY_L4, command_controller_task);
   Create(priority_t::PRIORITY_L5, timer_task);
   Create(priority_t::PRIORITY_IDLE, idle_task);
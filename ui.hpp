@@ -3,6 +3,7 @@
 #include <fpm/fixed.hpp>
 #include "kern/kstddefs.hpp"
 #include "kern/user_syscall_typed.hpp"
+#include "generic/containers.hpp"
 #include "generic/format.hpp"
 #include "generic/utils.hpp"
 #include "traffic.hpp"
@@ -18,9 +19,10 @@ enum class display_msg_header : uint64_t {
   USER_NOTICE = 's',
   TIMER_CLOCK_MSG = 't',
   SWITCHES = 'w',
-  TRAIN_READ,
+  TRAIN_READ,  // no payload: the train reads channel has something
   SENSOR_LOCK,
   SWITCH_LOCK,
+  TOP_TASKS,
 };
 
 struct timer_clock_t {
@@ -36,6 +38,23 @@ struct time_percentage_t {
   uint32_t idle;
 };
 
+// cpu usage of one task since the last sample. times are in percent
+struct task_usage_t {
+  tid_t tid;
+  uint32_t run;      // running in user mode
+  uint32_t ready;    // waiting to be scheduled
+  uint32_t blocked;  // waiting on another task or an event
+  uint32_t dispatches;
+};
+
+static constexpr size_t NUM_TOP_TASKS = 8;
+
+// tasks with the highest run time since the last sample, in decreasing order
+struct top_tasks_t {
+  uint32_t num_tasks;
+  task_usage_t tasks[NUM_TOP_TASKS];
+};
+
 using sensor_read = traffic::sensor_read;
 using switch_read = traffic::switch_cmd;
 
@@ -68,6 +87,26 @@ using switch_lock = sensor_lock;
 
 const char * const DISPLAY_CONTROLLER_NAME = "displayc";
 
+/**
+ * train table updates, which come for every train on every prediction. they go
+ * through shared memory, so the traffic server never waits on the display controller.
+ * when the ring is full, updates are dropped; a newer one follows soon.
+ */
+struct train_reads_channel {
+  // producer side, for the traffic server only
+  void publish(train_read const &read) {
+    if (ring.push(read) && ring.signal_wanted()) {
+      SignalChannel(channel);
+    }
+  }
+
+  troll::spsc_ring<train_read, 32> ring;
+  // the kernel event of the ring, registered by the consumer before its first wait
+  volatile int channel = -1;
+};
+
+train_reads_channel &train_reads();
+
 void init_tasks();
 
 struct ui_sender {
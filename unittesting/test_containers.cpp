@@ -132,3 +132,270 @@ TEST_CASE("scheduling queue", "[containers]") {
   }
 }
 
+TEST_CASE("scheduling queue remove", "[containers]") {
+  troll::intrusive_priority_scheduling_queue<test_elem, 4> q;
+  test_elem data[] = {'0', '1', '2', '3', '4'};
+
+  q.push(data[0], 1); q.push(data[1], 1); q.push(data[2], 1);
+  q.push(data[3], 3);
+
+  REQUIRE(q.remove(data[1], 1));
+  REQUIRE(q.size() == 3);
+  // not in the queue, or not at that priority
+  REQUIRE_FALSE(q.remove(data[4], 1));
+  REQUIRE_FALSE(q.remove(data[0], 2));
+  REQUIRE(q.size() == 3);
+
+  // moving an element to another priority puts it at the back there
+  REQUIRE(q.remove(data[3], 3));
+  q.push(data[3], 1);
+  REQUIRE(q.front_priority() == 1);
+  REQUIRE(&q.pop() == data + 0);
+  REQUIRE(&q.pop() == data + 2);
+  REQUIRE(&q.pop() == data + 3);
+  REQUIRE(q.size() == 0);
+}
+
+TEST_CASE("scheduling queue ordered push", "[containers]") {
+  troll::intrusive_priority_scheduling_queue<test_elem, 4> q;
+  // lower marks first, and 'z' never comes before anything, like an aperiodic task
+  test_elem data[] = {'z', 'c', 'a', 'z', 'b', 'a'};
+  auto less = [](test_elem &a, test_elem &b) { return a.mark != 'z' && a.mark < b.mark; };
+
+  q.push(data[0], 2);
+  q.push_ordered(data[1], 2, less);
+  q.push_ordered(data[2], 2, less);
+  q.push(data[3], 2);
+  q.push_ordered(data[4], 2, less);
+  // equal ones keep fifo order
+  q.push_ordered(data[5], 2, less);
+  REQUIRE(q.size() == 6);
+  REQUIRE(q.front_priority() == 2);
+
+  REQUIRE(&q.pop() == data + 2);
+  REQUIRE(&q.pop() == data + 5);
+  REQUIRE(&q.pop() == data + 4);
+  REQUIRE(&q.pop() == data + 1);
+  REQUIRE(&q.pop() == data + 0);
+  REQUIRE(&q.pop() == data + 3);
+  REQUIRE(q.size() == 0);
+
+  // into an empty queue
+  q.push_ordered(data[1], 0, less);
+  REQUIRE(q.front_priority() == 0);
+  REQUIRE(&q.pop() == data + 1);
+}
+
+TEST_CASE("scheduling queue with many priorities", "[containers]") {
+  troll::intrusive_priority_scheduling_queue<test_elem, 64> q;
+  test_elem data[] = {'0', '1', '2', '3'};
+
+  q.push(data[0], 0);
+  q.push(data[1], 63);
+  q.push(data[2], 31);
+  q.push(data[3], 32);
+  REQUIRE(q.front_priority() == 63);
+  REQUIRE(&q.pop() == data + 1);
+  REQUIRE(q.front_priority() == 32);
+  REQUIRE(&q.pop() == data + 3);
+  REQUIRE(&q.pop() == data + 2);
+  // refilling an emptied priority sets it ready again
+  q.push(data[1], 63);
+  REQUIRE(&q.pop() == data + 1);
+  REQUIRE(&q.pop() == data + 0);
+  REQUIRE(q.size() == 0);
+}
+
+namespace {
+  // worst case for a linear scan: only the lowest priority holds tasks
+  template<size_t NPriorities>
+  void benchmark_scheduling_queue_pop(const char *name) {
+    troll::intrusive_priority_scheduling_queue<test_elem, NPriorities> q;
+    test_elem data[] = {'0', '1', '2', '3'};
+    for (auto &elem : data) {
+      q.push(elem, 0);
+    }
+    BENCHMARK(name) {
+      auto &elem = q.pop();
+      q.push(elem, 0);
+      return &elem;
+    };
+  }
+}  // namespace
+
+TEST_CASE("scheduling queue pop latency", "[.][benchmark]") {
+  benchmark_scheduling_queue_pop<12>("pop with 12 priorities");
+  benchmark_scheduling_queue_pop<32>("pop with 32 priorities");
+  benchmark_scheduling_queue_pop<64>("pop with 64 priorities");
+}
+
+TEST_CASE("ring buffer", "[containers]") {
+  troll::ring_buffer<char, 4> r;
+  REQUIRE(r.empty());
+
+  r.push('a'); r.push('b'); r.push('c');
+  REQUIRE(r.size() == 3);
+  REQUIRE(r.front() == 'a');
+  REQUIRE(r.pop() == 'a');
+  // wraps around the end of the storage
+  r.push('d'); r.push('e');
+  REQUIRE(r.full());
+  REQUIRE(r.pop() == 'b');
+  REQUIRE(r.pop() == 'c');
+  REQUIRE(r.pop() == 'd');
+  REQUIRE(r.pop() == 'e');
+  REQUIRE(r.empty());
+
+  // many times around
+  for (int i = 0; i < 1000; ++i) {
+    r.push(i & 0x7f);
+    REQUIRE(r.pop() == (i & 0x7f));
+  }
+  REQUIRE(r.size() == 0);
+}
+
+TEST_CASE("deadline queue ordering", "[containers]") {
+  static constexpr size_t N = 4096;
+  static troll::deadline_queue<uint32_t, N> q;
+  REQUIRE(q.empty());
+
+  // deterministic pseudo random delays, with plenty of duplicates
+  uint32_t seed = 452;
+  for (uint32_t i = 0; i < N; ++i) {
+    seed = seed * 1103515245 + 12345;
+    q.push((seed >> 8) % 1000, i);
+  }
+  REQUIRE(q.size() == N);
+  REQUIRE(!q.expired(q.top().deadline - 1));
+
+  uint32_t last = 0;
+  size_t popped = 0;
+  for (uint32_t now = 0; now < 1000; ++now) {
+    while (q.expired(now)) {
+      REQUIRE(q.top().deadline == now);
+      REQUIRE(q.top().deadline >= last);
+      last = q.top().deadline;
+      q.pop();
+      ++popped;
+    }
+  }
+  REQUIRE(popped == N);
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("deadline queue across overflow", "[containers]") {
+  static constexpr size_t N = 2048;
+  static troll::deadline_queue<uint32_t, N> q;
+  // start close to the end of the counter so half of the deadlines wrap around
+  uint32_t start = UINT32_MAX - N / 2;
+
+  // push in reverse so every push has to bubble up
+  for (uint32_t i = N; i-- > 0;) {
+    q.push(start + i + 1, i);
+  }
+  REQUIRE(!q.expired(start));
+
+  uint32_t now = start;
+  for (uint32_t i = 0; i < N; ++i) {
+    ++now;
+    REQUIRE(q.expired(now));
+    REQUIRE(q.top().value == i);
+    REQUIRE(q.top().deadline == now);
+    q.pop();
+    REQUIRE(!q.expired(now));
+  }
+  REQUIRE(now < start);  // the counter did wrap
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("log2 histogram", "[containers]") {
+  troll::log2_histogram<8> h {};
+  REQUIRE(h.percentile(50) == 0);
+
+  REQUIRE(h.bucket_of(0) == 0);
+  REQUIRE(h.bucket_of(1) == 1);
+  REQUIRE(h.bucket_of(2) == 2);
+  REQUIRE(h.bucket_of(3) == 2);
+  REQUIRE(h.bucket_of(64) == 7);
+  REQUIRE(h.bucket_of(UINT32_MAX) == 7);  // overflow bucket
+
+  // 98 fast samples and 2 slow ones
+  for (int i = 0; i < 98; ++i) {
+    h.record(5);
+  }
+  h.record(100);
+  h.record(40);
+  REQUIRE(h.count == 100);
+  REQUIRE(h.max == 100);
+  REQUIRE(h.buckets[3] == 98);
+  REQUIRE(h.percentile(50) == 7);
+  REQUIRE(h.percentile(98) == 7);
+  REQUIRE(h.percentile(99) == 63);
+  REQUIRE(h.percentile(100) == 100);
+}
+
+TEST_CASE("message queue", "[containers]") {
+  troll::message_queue<32> q;
+  REQUIRE(q.empty());
+  char out[32];
+
+  REQUIRE(q.push("ab", 2));
+  REQUIRE(q.push("", 0));
+  REQUIRE(q.push("cdefg", 5));
+  REQUIRE(q.size() == 3);
+  REQUIRE(q.used() == 13);  // each message takes two more bytes for its length
+  REQUIRE(q.front_size() == 2);
+  REQUIRE(q.pop(out) == 2);
+  REQUIRE(memcmp(out, "ab", 2) == 0);
+  REQUIRE(q.pop(out) == 0);
+
+  // only 32 - 7 bytes are left
+  REQUIRE(!q.push("0123456789abcdefghijklm", 24));
+  // this one wraps around the end of the arena
+  REQUIRE(q.push("0123456789abcdefghijk", 21));
+  REQUIRE(q.pop(out) == 5);
+  REQUIRE(memcmp(out, "cdefg", 5) == 0);
+  REQUIRE(q.front_size() == 21);
+  REQUIRE(q.pop(out) == 21);
+  REQUIRE(memcmp(out, "0123456789abcdefghijk", 21) == 0);
+  REQUIRE(q.empty());
+  REQUIRE(q.used() == 0);
+
+  // many times around, with the length prefix split over the end too
+  for (int i = 0; i < 1000; ++i) {
+    size_t len = i % 11;
+    char in[11];
+    for (size_t j = 0; j < len; ++j) {
+      in[j] = i + j;
+    }
+    REQUIRE(q.push(in, len));
+    REQUIRE(q.pop(out) == len);
+    REQUIRE(memcmp(out, in, len) == 0);
+  }
+}
+
+TEST_CASE("spsc ring", "[containers]") {
+  troll::spsc_ring<int, 4> r;
+  int value = 0;
+  REQUIRE(!r.pop(value));
+
+  // an empty ring lets the consumer sleep, and the next push wakes it once
+  REQUIRE(r.prepare_wait());
+  REQUIRE(r.push(1));
+  REQUIRE(r.signal_wanted());
+  REQUIRE(r.push(2));
+  REQUIRE(!r.signal_wanted());
+
+  // the consumer does not sleep while there is something to pop
+  REQUIRE(!r.prepare_wait());
+  REQUIRE(r.pop(value));
+  REQUIRE(value == 1);
+  REQUIRE(r.push(3)); REQUIRE(r.push(4)); REQUIRE(r.push(5));
+  REQUIRE(!r.push(6));  // full
+  for (int expected = 2; expected <= 5; ++expected) {
+    REQUIRE(r.pop(value));
+    REQUIRE(value == expected);
+  }
+  REQUIRE(r.empty());
+  REQUIRE(!r.signal_wanted());
+}
@@ -9,6 +9,7 @@
 #include "ui.hpp"
 #include "kern/merklin.hpp"
 #include "kern/gtkterm.hpp"
+#include "kern/pubsub.hpp"
 #include "tcmd.hpp"
 #include "traffic.hpp"
 
@@ -247,39 +248,109 @@ void perf_receiver() {
   // receiver task will starve: THIS is intentional to make things simpler
 }
 
+void perf_short_receiver() {
+  uint64_t buffer[MAX_SHORT_MESSAGE_SIZE / sizeof(uint64_t)] {};
+  tid_t tid;
+  while (1) {
+    auto len = ReceiveValue(tid, buffer);
+    ReplyShort(tid, buffer[0], buffer[1], len);
+  }
+}
+
+void perf_reply_receive_receiver() {
+  char buffer[256];
+  tid_t tid = 0;
+  int len = 0;
+  while (1) {
+    // the reply is sent out before the next message is received into the same buffer
+    len = ReplyReceiveValue(tid, buffer, len, tid, buffer);
+  }
+}
+
+void perf_exit_task() {}
+
+// create/exit and send costs while nearly all small stacks are taken by blocked tasks
+void perf_task_table() {
+  tid_t filler = 0;
+  size_t num_tasks = 0;
+  for (int tid; (tid = Create(PRIORITY_L5, perf_receiver, STACK_SMALL)) > 0; ++num_tasks) {
+    filler = tid;
+  }
+
+  // the child runs first and exits right away
+  auto start_tick = GET_TIMER_COUNT();
+  for (size_t i = 0; i < PERF_REPEAT; ++i) {
+    Create(PRIORITY_L3, perf_exit_task, STACK_MEDIUM);
+  }
+  auto create_exit_per = (GET_TIMER_COUNT() - start_tick) / PERF_REPEAT * NUM_TICKS_IN_1US;
+
+  int value = 0, reply = 0;
+  start_tick = GET_TIMER_COUNT();
+  for (size_t i = 0; i < PERF_REPEAT; ++i) {
+    SendValue(filler, value, reply);
+  }
+  auto send_per = (GET_TIMER_COUNT() - start_tick) / PERF_REPEAT * NUM_TICKS_IN_1US;
+
+  // tasks {blocked tasks} {create+exit time} {send time}
+  char buf[100];
+  auto len = troll::snformat(buf, "tasks {} {} {}\r\n", num_tasks, create_exit_per, send_per);
+  uart_puts(0, 0, buf, len);
+}
+
 void perf_task() {
-  size_t sizes[] = { 4, 64, 256 };
+  size_t sizes[] = { 4, 16, 64, 256 };
   char send_buf[256], recv_buf[256];
   memset(send_buf, 0, sizeof send_buf / sizeof send_buf[0]);
   memset(recv_buf, 0, sizeof recv_buf / sizeof recv_buf[0]);
 
   unsigned start_tick;
-  // run nocache first -> then with caches
-  for (int cache_i = 0; cache_i < 4; ++cache_i) {
+  // run nocache first -> then with caches. the caches cannot be changed in SMP builds,
+  // so only the first and the last column are measured there
+  for (int cache_i = 0; cache_i < 6; ++cache_i) {
     char const *cache;
+    int set = 0;
     switch (cache_i) {
     case 0:  // SETUP nocache
+#if MMU
+      // boot.S already turned on the mmu and the caches
+      cache = "boot";
+#else
       cache = "nocache";
+#endif
       break;
     case 1:  // SETUP icache
       cache = "icache";
-      ICache();
+      set = ICache();
       break;
     case 2:  // SETIP bcache
       cache = "bcache";
-      BCache();
+      set = BCache();
       break;
     case 3:  // SETUP dcache
-    default:
       cache = "dcache";
-      DCache();
+      set = DCache();
+      break;
+    case 4:  // SETUP mmu, only now is ram actually cached
+      cache = "mmu+dcache";
+      set = MMUCache();
+      break;
+    case 5:  // SETUP same caches, but syscalls save every register. the difference to the
+             // last column is what the short syscall frame saves
+    default:
+      cache = "fullframe";
+      FullFrames(true);
       break;
     }
+    if (set < 0) {
+      continue;
+    }
     for (int sender_first = 0; sender_first < 2; ++sender_first) {
       // in receiver first situation, the first ever receive call by the receiver is not
       // contained in the timing. this should not be a problem given PERF_REPEAT is big.
-      auto target_tid = sender_first ? Create(PRIORITY_L5, perf_receiver)
-        : Create(PRIORITY_L4, perf_receiver);
+      auto receiver_priority = sender_first ? PRIORITY_L5 : PRIORITY_L4;
+      auto target_tid = Create(receiver_priority, perf_receiver);
+      auto short_target_tid = Create(receiver_priority, perf_short_receiver);
+      auto rr_target_tid = Create(receiver_priority, perf_reply_receive_receiver);
       char const *RS = sender_first ? "S" : "R";
 
       for (size_t sz_i = 0; sz_i < sizeof sizes / sizeof sizes[0]; ++sz_i) {
@@ -289,13 +360,33 @@ void perf_task() {
           SendValue(target_tid, send_buf, size, recv_buf, size);
         }
         auto ms_per = (GET_TIMER_COUNT() - start_tick) / PERF_REPEAT * NUM_TICKS_IN_1US;
-        // {nocache|icache|dcache|bcache} {R|S} {4|64|256} {time}
+
+        // register-passing path, only for messages that fit
+        char short_ms_per[16] = "-";
+        if (size <= MAX_SHORT_MESSAGE_SIZE) {
+          start_tick = GET_TIMER_COUNT();
+          for (size_t i = 0; i < PERF_REPEAT; ++i) {
+            SendShort(short_target_tid, i, ~i, size, recv_buf, size);
+          }
+          troll::snformat(short_ms_per, "{}", (GET_TIMER_COUNT() - start_tick) / PERF_REPEAT * NUM_TICKS_IN_1US);
+        }
+
+        // receiver replies and receives in one kernel entry
+        start_tick = GET_TIMER_COUNT();
+        for (size_t i = 0; i < PERF_REPEAT; ++i) {
+          SendValue(rr_target_tid, send_buf, size, recv_buf, size);
+        }
+        auto rr_ms_per = (GET_TIMER_COUNT() - start_tick) / PERF_REPEAT * NUM_TICKS_IN_1US;
+
+        // {nocache|boot|icache|bcache|dcache|mmu+dcache|fullframe} {R|S} {4|16|64|256} {copy time} {register time|-} {replyreceive time}
         char buf[100];
-        auto len = troll::snformat(buf, "{} {} {} {}\r\n", cache, RS, size, ms_per);
+        auto len = troll::snformat(buf, "{} {} {} {} {} {}\r\n", cache, RS, size, ms_per, short_ms_per, rr_ms_per);
         uart_puts(0, 0, buf, len);
       }
     }
   }
+  FullFrames(false);
+  perf_task_table();
 }
 
 void perf_main_task() {
@@ -426,9 +517,10 @@ void first_user_task() {
 namespace k4 {
 
 void first_user_task() {
-  Create(priority_t::PRIORITY_L1, nameserver);
-  Create(priority_t::PRIORITY_L1, clockserver);
-  Create(priority_t::PRIORITY_L1, clocknotifier);
+  Create(priority_t::PRIORITY_L1, nameserver, STACK_MEDIUM);
+  Create(priority_t::PRIORITY_L1, clockserver, STACK_MEDIUM);
+  Create(priority_t::PRIORITY_L1, clocknotifier, STACK_SMALL);
+  pubsub::init_tasks();
   gtkterm::init_tasks();
   merklin::init_tasks();
   traffic::init_tasks();